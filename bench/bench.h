@@ -0,0 +1,53 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * bench.h
+ *
+ * Timing helpers shared by the microbenchmarks in bench/
+ */
+
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/**
+ * Returns a monotonic timestamp in nanoseconds
+ */
+static inline uint64_t bench_now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Prints the result of a timed run
+ *  - name: What was measured
+ *  - ops: How many operations the run performed
+ *  - start: bench_now_ns() at the start of the run
+ */
+static inline void bench_report(const char* name, uint64_t ops, uint64_t start)
+{
+	uint64_t elapsed = bench_now_ns() - start;
+	printf("%-40s %10.1f ns/op %12.0f ops/s\n", name, (double)elapsed/ops, ops*1e9/elapsed);
+}
+
+#endif /* _BENCH_H_ */
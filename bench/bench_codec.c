@@ -0,0 +1,131 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * bench_codec.c
+ *
+ * Compares the flagged codec_t accessors with the unchecked _fast ones
+ * from codec_fast.h, validating each record once with codec_has or
+ * codec_ensure
+ */
+
+#include <runite/util/codec.h>
+#include <runite/util/codec_fast.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "bench.h"
+
+#define NUM_RECORDS (1 << 20)
+#define RECORD_SIZE 9
+#define ROUNDS 20
+
+static volatile uint32_t sink;
+
+/**
+ * Writes records of a 16, 24 and 32 bit field with the flagged API
+ */
+static void put_flagged(codec_t* codec)
+{
+	codec_seek(codec, 0);
+	for (uint32_t i = 0; i < NUM_RECORDS; i++) {
+		codec_put16(codec, i);
+		codec_put24(codec, i);
+		codec_put32(codec, i);
+	}
+}
+
+/**
+ * Writes the same records with the _fast accessors
+ */
+static void put_fast(codec_t* codec)
+{
+	codec_seek(codec, 0);
+	for (uint32_t i = 0; i < NUM_RECORDS; i++) {
+		if (!codec_ensure(codec, RECORD_SIZE)) {
+			return;
+		}
+		codec_put16_fast(codec, i);
+		codec_put24_fast(codec, i);
+		codec_put32_fast(codec, i);
+	}
+}
+
+/**
+ * Reads the records back with the flagged API
+ */
+static void get_flagged(codec_t* codec)
+{
+	uint32_t sum = 0;
+	codec_seek(codec, 0);
+	for (uint32_t i = 0; i < NUM_RECORDS; i++) {
+		sum += codec_get16(codec);
+		sum += codec_get24(codec);
+		sum += codec_get32(codec);
+	}
+	sink = sum;
+}
+
+/**
+ * Reads the records back with the _fast accessors
+ */
+static void get_fast(codec_t* codec)
+{
+	uint32_t sum = 0;
+	codec_seek(codec, 0);
+	for (uint32_t i = 0; i < NUM_RECORDS; i++) {
+		if (!codec_has(codec, RECORD_SIZE)) {
+			return;
+		}
+		sum += codec_get16_fast(codec);
+		sum += codec_get24_fast(codec);
+		sum += codec_get32_fast(codec);
+	}
+	sink = sum;
+}
+
+/**
+ * Times ROUNDS passes of func, reporting the cost per field
+ */
+static void bench_run(const char* name, void (*func)(codec_t*), codec_t* codec)
+{
+	uint64_t start = bench_now_ns();
+	for (int i = 0; i < ROUNDS; i++) {
+		func(codec);
+	}
+	bench_report(name, (uint64_t)ROUNDS*NUM_RECORDS*3, start);
+}
+
+int main()
+{
+	unsigned char* buffer = (unsigned char*)malloc((size_t)NUM_RECORDS*RECORD_SIZE);
+	if (buffer == NULL) {
+		return 1;
+	}
+	codec_t codec;
+	codec_wrap(&codec, buffer, (size_t)NUM_RECORDS*RECORD_SIZE);
+
+	bench_run("codec_put{16,24,32}", put_flagged, &codec);
+	bench_run("codec_put{16,24,32}_fast", put_fast, &codec);
+	bench_run("codec_get{16,24,32}", get_flagged, &codec);
+	bench_run("codec_get{16,24,32}_fast", get_fast, &codec);
+
+	object_free(&codec);
+	free(buffer);
+	return 0;
+}
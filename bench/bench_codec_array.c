@@ -0,0 +1,130 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * bench_codec_array.c
+ *
+ * Compares the bulk codec_{get,put}{16,32}_array calls with a loop of
+ * single codec_get16fp/codec_put16f calls, and with a plain memcpy
+ */
+
+#include <runite/util/codec.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+
+#define NUM_VALUES (1 << 20)
+#define ROUNDS 20
+
+/**
+ * Gets NUM_VALUES 16 bit values one call at a time
+ */
+static void get16_loop(codec_t* codec, uint16_t* values, uint8_t flags)
+{
+	for (size_t i = 0; i < NUM_VALUES; i++) {
+		codec_get16fp(codec, &values[i], flags);
+	}
+}
+
+/**
+ * Gets NUM_VALUES 16 bit values in one call
+ */
+static void get16_array(codec_t* codec, uint16_t* values, uint8_t flags)
+{
+	codec_get16_array(codec, values, NUM_VALUES, flags);
+}
+
+/**
+ * Puts NUM_VALUES 16 bit values one call at a time
+ */
+static void put16_loop(codec_t* codec, uint16_t* values, uint8_t flags)
+{
+	for (size_t i = 0; i < NUM_VALUES; i++) {
+		codec_put16f(codec, values[i], flags);
+	}
+}
+
+/**
+ * Puts NUM_VALUES 16 bit values in one call
+ */
+static void put16_array(codec_t* codec, uint16_t* values, uint8_t flags)
+{
+	codec_put16_array(codec, values, NUM_VALUES, flags);
+}
+
+/**
+ * Gets NUM_VALUES 32 bit values in one call
+ */
+static void get32_array(codec_t* codec, uint16_t* values, uint8_t flags)
+{
+	codec_get32_array(codec, (uint32_t*)values, NUM_VALUES/2, flags);
+}
+
+/**
+ * Copies the same number of bytes with memcpy, as a baseline
+ */
+static void copy(codec_t* codec, uint16_t* values, uint8_t flags)
+{
+	memcpy(values, codec->data, sizeof(uint16_t)*NUM_VALUES);
+}
+
+/**
+ * Times ROUNDS passes of func over the whole buffer
+ */
+static void bench_run(const char* name, void (*func)(codec_t*, uint16_t*, uint8_t), codec_t* codec, uint16_t* values, uint8_t flags)
+{
+	uint64_t start = bench_now_ns();
+	for (int i = 0; i < ROUNDS; i++) {
+		codec_seek(codec, 0);
+		func(codec, values, flags);
+	}
+	bench_report(name, (uint64_t)ROUNDS*NUM_VALUES, start);
+}
+
+int main()
+{
+	size_t size = sizeof(uint16_t)*NUM_VALUES;
+	unsigned char* buffer = (unsigned char*)malloc(size);
+	uint16_t* values = (uint16_t*)malloc(size);
+	if (buffer == NULL || values == NULL) {
+		return 1;
+	}
+	for (size_t i = 0; i < NUM_VALUES; i++) {
+		values[i] = (uint16_t)(i*40503);
+	}
+	codec_t codec;
+	codec_wrap(&codec, buffer, size);
+
+	bench_run("memcpy (per 16 bit value)", copy, &codec, values, 0);
+	bench_run("codec_put16f loop", put16_loop, &codec, values, 0);
+	bench_run("codec_put16_array", put16_array, &codec, values, 0);
+	bench_run("codec_put16f loop, OFS128", put16_loop, &codec, values, CODEC_OFS128);
+	bench_run("codec_put16_array, OFS128", put16_array, &codec, values, CODEC_OFS128);
+	bench_run("codec_get16fp loop", get16_loop, &codec, values, 0);
+	bench_run("codec_get16_array", get16_array, &codec, values, 0);
+	bench_run("codec_get16fp loop, OFS128", get16_loop, &codec, values, CODEC_OFS128);
+	bench_run("codec_get16_array, OFS128", get16_array, &codec, values, CODEC_OFS128);
+	bench_run("codec_get32_array (per 16 bits)", get32_array, &codec, values, 0);
+
+	object_free(&codec);
+	free(values);
+	free(buffer);
+	return 0;
+}
@@ -0,0 +1,172 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * bench_crc.c
+ *
+ * Compares cache_gen_crc with cache_gen_crc_parallel on a thread pool.
+ * Without arguments a synthetic single index cache is generated in a
+ * temporary directory, otherwise the given cache directory is used.
+ */
+
+#include <runite/cache.h>
+#include <runite/util/thread_pool.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+#define NUM_FILES 2000
+#define MAX_FILE_SIZE (32*1024)
+#define DATA_BLOCK_SIZE 520
+#define DATA_BLOCK_DATA 512
+#define NUM_WORKERS 4
+#define ROUNDS 10
+
+/**
+ * Writes a cache with a single index of NUM_FILES files of random sizes
+ *  - directory: An existing, empty directory
+ * returns: Whether the cache was written
+ */
+static bool bench_write_cache(const char* directory)
+{
+	char dat_path[PATH_MAX];
+	char idx_path[PATH_MAX];
+	snprintf(dat_path, sizeof(dat_path), "%s/main_file_cache.dat", directory);
+	snprintf(idx_path, sizeof(idx_path), "%s/main_file_cache.idx0", directory);
+	FILE* dat = fopen(dat_path, "wb");
+	FILE* idx = fopen(idx_path, "wb");
+	bool success = dat != NULL && idx != NULL;
+
+	/* block 0 is never used, a first block of 0 means the file is empty */
+	unsigned char block[DATA_BLOCK_SIZE] = {0};
+	uint32_t next_block = 1;
+	if (success) {
+		success = fwrite(block, DATA_BLOCK_SIZE, 1, dat) == 1;
+	}
+
+	srand(1234);
+	for (int file_id = 0; success && file_id < NUM_FILES; file_id++) {
+		uint32_t length = rand() % MAX_FILE_SIZE;
+		uint32_t num_blocks = (length + DATA_BLOCK_DATA - 1) / DATA_BLOCK_DATA;
+		uint32_t first_block = num_blocks > 0 ? next_block : 0;
+		unsigned char entry[6] = {
+			length >> 16, length >> 8, length,
+			first_block >> 16, first_block >> 8, first_block
+		};
+		success = fwrite(entry, sizeof(entry), 1, idx) == 1;
+
+		for (uint32_t part = 0; success && part < num_blocks; part++) {
+			uint32_t next = part+1 < num_blocks ? next_block+1 : 0;
+			block[0] = file_id >> 8;
+			block[1] = file_id;
+			block[2] = part >> 8;
+			block[3] = part;
+			block[4] = next >> 16;
+			block[5] = next >> 8;
+			block[6] = next;
+			block[7] = 1;
+			for (int i = 8; i < DATA_BLOCK_SIZE; i++) {
+				block[i] = rand();
+			}
+			success = fwrite(block, DATA_BLOCK_SIZE, 1, dat) == 1;
+			next_block++;
+		}
+	}
+
+	if (dat != NULL) {
+		success = fclose(dat) == 0 && success;
+	}
+	if (idx != NULL) {
+		success = fclose(idx) == 0 && success;
+	}
+	return success;
+}
+
+/**
+ * Removes the cache written by bench_write_cache
+ */
+static void bench_remove_cache(const char* directory)
+{
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/main_file_cache.dat", directory);
+	unlink(path);
+	snprintf(path, sizeof(path), "%s/main_file_cache.idx0", directory);
+	unlink(path);
+	rmdir(directory);
+}
+
+int main(int argc, char** argv)
+{
+	char directory[] = "/tmp/runite_bench_XXXXXX";
+	const char* cache_dir = argc > 1 ? argv[1] : NULL;
+	if (cache_dir == NULL) {
+		if (mkdtemp(directory) == NULL) {
+			return 1;
+		}
+		if (!bench_write_cache(directory)) {
+			bench_remove_cache(directory);
+			return 1;
+		}
+		cache_dir = directory;
+	}
+
+	cache_t* cache = object_new(cache);
+	thread_pool_t* pool = object_new(thread_pool);
+	int result = cache_open_fs_dir(cache, cache_dir);
+	if (cache_dir == directory) {
+		bench_remove_cache(directory);
+	}
+	if (result != CACHE_OK || !thread_pool_start(pool, NUM_WORKERS)) {
+		object_free(pool);
+		object_free(cache);
+		return 1;
+	}
+
+	uint64_t num_files = 0;
+	uint64_t start = bench_now_ns();
+	for (int round = 0; round < ROUNDS; round++) {
+		for (int index = 0; index < cache->num_indices; index++) {
+			file_t crc;
+			cache_gen_crc(cache, index, &crc);
+			file_free(&crc);
+			num_files += cache->num_files[index];
+		}
+	}
+	bench_report("cache_gen_crc (per file)", num_files, start);
+
+	num_files = 0;
+	start = bench_now_ns();
+	for (int round = 0; round < ROUNDS; round++) {
+		for (int index = 0; index < cache->num_indices; index++) {
+			file_t crc;
+			cache_gen_crc_parallel(pool, cache, index, &crc);
+			file_free(&crc);
+			num_files += cache->num_files[index];
+		}
+	}
+	bench_report("cache_gen_crc_parallel, 4 workers", num_files, start);
+
+	object_free(pool);
+	object_free(cache);
+	return 0;
+}
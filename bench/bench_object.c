@@ -0,0 +1,133 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * bench_object.c
+ *
+ * Compares object_new/object_free for a slab backed prototype against the
+ * same type going through malloc, single threaded and across threads
+ */
+
+#include <runite/util/object.h>
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "bench.h"
+
+#define ITERATIONS 2000000
+#define BATCH_SIZE 256
+#define NUM_THREADS 4
+
+typedef struct slab_obj slab_obj_t;
+typedef struct heap_obj heap_obj_t;
+
+struct slab_obj {
+	object_t object;
+	uint64_t payload[6];
+};
+
+struct heap_obj {
+	object_t object;
+	uint64_t payload[6];
+};
+
+static void bench_obj_init(void* obj) { }
+static void bench_obj_free(void* obj) { }
+
+static object_slab_t slab_obj_slab = OBJECT_SLAB_INITIALIZER;
+object_proto_t slab_obj_proto = {
+	.init = (object_init_t)bench_obj_init,
+	.free = (object_free_t)bench_obj_free,
+	.slab = &slab_obj_slab
+};
+
+object_proto_t heap_obj_proto = {
+	.init = (object_init_t)bench_obj_init,
+	.free = (object_free_t)bench_obj_free
+};
+
+/**
+ * Allocates and frees one object at a time
+ */
+static void* bench_single(void* proto)
+{
+	for (int i = 0; i < ITERATIONS; i++) {
+		object_t* obj = _object_new((const object_proto_t*)proto, sizeof(slab_obj_t));
+		object_free(obj);
+	}
+	return NULL;
+}
+
+/**
+ * Allocates a batch of objects before freeing them all, which has the slab
+ * refill and spill its per thread cache
+ */
+static void* bench_batch(void* proto)
+{
+	object_t* objs[BATCH_SIZE];
+	for (int i = 0; i < ITERATIONS/BATCH_SIZE; i++) {
+		for (int j = 0; j < BATCH_SIZE; j++) {
+			objs[j] = _object_new((const object_proto_t*)proto, sizeof(slab_obj_t));
+		}
+		for (int j = 0; j < BATCH_SIZE; j++) {
+			object_free(objs[j]);
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Runs a bench on NUM_THREADS threads at once
+ */
+static void bench_threaded(void* (*func)(void*), const object_proto_t* proto)
+{
+	pthread_t threads[NUM_THREADS];
+	for (int i = 0; i < NUM_THREADS; i++) {
+		pthread_create(&threads[i], NULL, func, (void*)proto);
+	}
+	for (int i = 0; i < NUM_THREADS; i++) {
+		pthread_join(threads[i], NULL);
+	}
+}
+
+int main()
+{
+	uint64_t start;
+
+	start = bench_now_ns();
+	bench_single(&slab_obj_proto);
+	bench_report("slab new/free", ITERATIONS, start);
+	start = bench_now_ns();
+	bench_single(&heap_obj_proto);
+	bench_report("malloc new/free", ITERATIONS, start);
+
+	start = bench_now_ns();
+	bench_batch(&slab_obj_proto);
+	bench_report("slab batched new/free", ITERATIONS, start);
+	start = bench_now_ns();
+	bench_batch(&heap_obj_proto);
+	bench_report("malloc batched new/free", ITERATIONS, start);
+
+	start = bench_now_ns();
+	bench_threaded(bench_batch, &slab_obj_proto);
+	bench_report("slab batched new/free, 4 threads", (uint64_t)ITERATIONS*NUM_THREADS, start);
+	start = bench_now_ns();
+	bench_threaded(bench_batch, &heap_obj_proto);
+	bench_report("malloc batched new/free, 4 threads", (uint64_t)ITERATIONS*NUM_THREADS, start);
+	return 0;
+}
@@ -0,0 +1,186 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * bench_queue.c
+ *
+ * Pushes items from several producer threads to a single consumer through
+ * mpsc_queue_t, mpmc_ring_t and a queue_t guarded by a mutex
+ */
+
+#include <runite/util/queue.h>
+#include <runite/util/mpsc_queue.h>
+#include <runite/util/mpmc_ring.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "bench.h"
+
+#define ITEMS_PER_PRODUCER 500000
+#define NUM_PRODUCERS 4
+#define RING_CAPACITY 1024
+
+typedef struct bench_queue bench_queue_t;
+
+/**
+ * The queue under test, and a node for every item pushed to it
+ */
+struct bench_queue {
+	queue_t* locked;
+	pthread_mutex_t lock;
+	mpsc_queue_t* mpsc;
+	mpmc_ring_t* ring;
+	list_node_t* nodes;
+};
+
+typedef struct bench_producer bench_producer_t;
+
+/**
+ * A producer thread's share of the nodes
+ */
+struct bench_producer {
+	bench_queue_t* queue;
+	list_node_t* nodes;
+};
+
+/**
+ * Pushes a producer's items to the locked queue_t
+ */
+static void* locked_produce(bench_producer_t* producer)
+{
+	for (int i = 0; i < ITEMS_PER_PRODUCER; i++) {
+		pthread_mutex_lock(&producer->queue->lock);
+		queue_push(producer->queue->locked, &producer->nodes[i]);
+		pthread_mutex_unlock(&producer->queue->lock);
+	}
+	return NULL;
+}
+
+/**
+ * Pops count items from the locked queue_t, yielding while it's empty
+ */
+static void locked_consume(bench_queue_t* queue, uint64_t count)
+{
+	while (count > 0) {
+		list_node_t* node = NULL;
+		pthread_mutex_lock(&queue->lock);
+		if (!queue_empty(queue->locked)) {
+			node = queue_pop(queue->locked);
+		}
+		pthread_mutex_unlock(&queue->lock);
+		if (node == NULL) {
+			sched_yield();
+			continue;
+		}
+		count--;
+	}
+}
+
+/**
+ * Pushes a producer's items to the mpsc_queue_t
+ */
+static void* mpsc_produce(bench_producer_t* producer)
+{
+	for (int i = 0; i < ITEMS_PER_PRODUCER; i++) {
+		mpsc_queue_push(producer->queue->mpsc, &producer->nodes[i]);
+	}
+	return NULL;
+}
+
+/**
+ * Pops count items from the mpsc_queue_t
+ */
+static void mpsc_consume(bench_queue_t* queue, uint64_t count)
+{
+	while (count > 0) {
+		mpsc_queue_pop_wait(queue->mpsc, -1);
+		count--;
+	}
+}
+
+/**
+ * Pushes a producer's items to the mpmc_ring_t, yielding while it's full
+ */
+static void* ring_produce(bench_producer_t* producer)
+{
+	for (int i = 0; i < ITEMS_PER_PRODUCER; i++) {
+		while (!mpmc_ring_push(producer->queue->ring, &producer->nodes[i])) {
+			sched_yield();
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Pops count items from the mpmc_ring_t
+ */
+static void ring_consume(bench_queue_t* queue, uint64_t count)
+{
+	while (count > 0) {
+		mpmc_ring_pop_wait(queue->ring, -1);
+		count--;
+	}
+}
+
+/**
+ * Runs NUM_PRODUCERS producers against a consumer on the calling thread
+ */
+static void bench_run(const char* name, bench_queue_t* queue, void* (*produce)(bench_producer_t*), void (*consume)(bench_queue_t*, uint64_t))
+{
+	pthread_t threads[NUM_PRODUCERS];
+	bench_producer_t producers[NUM_PRODUCERS];
+	uint64_t count = (uint64_t)NUM_PRODUCERS*ITEMS_PER_PRODUCER;
+
+	uint64_t start = bench_now_ns();
+	for (int i = 0; i < NUM_PRODUCERS; i++) {
+		producers[i].queue = queue;
+		producers[i].nodes = queue->nodes + (size_t)i*ITEMS_PER_PRODUCER;
+		pthread_create(&threads[i], NULL, (void* (*)(void*))produce, &producers[i]);
+	}
+	consume(queue, count);
+	for (int i = 0; i < NUM_PRODUCERS; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	bench_report(name, count, start);
+}
+
+int main()
+{
+	bench_queue_t queue;
+	queue.nodes = (list_node_t*)malloc(sizeof(list_node_t)*NUM_PRODUCERS*ITEMS_PER_PRODUCER);
+	queue.locked = object_new(queue);
+	pthread_mutex_init(&queue.lock, NULL);
+	queue.mpsc = object_new(mpsc_queue);
+	queue.ring = object_new(mpmc_ring);
+	if (queue.nodes == NULL || queue.locked == NULL || queue.mpsc == NULL || queue.ring == NULL || !mpmc_ring_alloc(queue.ring, RING_CAPACITY)) {
+		return 1;
+	}
+
+	bench_run("queue_t + mutex, 4 producers", &queue, locked_produce, locked_consume);
+	bench_run("mpsc_queue_t, 4 producers", &queue, mpsc_produce, mpsc_consume);
+	bench_run("mpmc_ring_t, 4 producers", &queue, ring_produce, ring_consume);
+
+	object_free(queue.locked);
+	object_free(queue.mpsc);
+	object_free(queue.ring);
+	pthread_mutex_destroy(&queue.lock);
+	free(queue.nodes);
+	return 0;
+}
@@ -0,0 +1 @@
+BENCHES += $(addprefix bench/,bench_object bench_queue bench_codec bench_codec_array bench_crc)
@@ -26,14 +26,21 @@
 #include <runite/file.h>
 #include <runite/util/object.h>
 #include <runite/util/list.h>
+#include <runite/util/allocator.h>
+#include <runite/util/arena.h>
+#include <runite/util/codec.h>
+#include <runite/util/thread_pool.h>
 
 typedef struct archive archive_t;
 typedef struct archive_file archive_file_t;
+typedef struct archive_decoder archive_decoder_t;
 
 struct archive {
 	object_t object;
+	runite_allocator_t* allocator;
 	uint16_t num_files;
 	list_t files;
+	arena_t arena;
 };
 
 struct archive_file {
@@ -42,16 +49,54 @@ struct archive_file {
 	list_node_t node;
 };
 
+/**
+ * Resumable archive decompression, for spreading large decodes over
+ * several calls. progress/total track how much of the input has been consumed.
+ */
+struct archive_decoder {
+	object_t object;
+	archive_t* archive;
+	file_t* data;
+	int state;
+	codec_t codec;
+	void* inflater;
+	runite_allocator_t* inflater_allocator;
+	bool whole;
+	uint32_t final_len;
+	uint32_t container_len;
+	int num_files;
+	int cur_file;
+	size_t file_ofs;
+	uint32_t file_len;
+	archive_file_t* file;
+	size_t progress;
+	size_t total;
+};
+
 extern object_proto_t archive_proto;
+extern object_proto_t archive_decoder_proto;
 
 #define ARCHIVE_COMPRESS_FILE 0
 #define ARCHIVE_COMPRESS_WHOLE 1
 
+#define ARCHIVE_DECODE_ERROR -1
+#define ARCHIVE_DECODE_DONE 0
+#define ARCHIVE_DECODE_AGAIN 1
+
+bool archive_set_allocator(archive_t* archive, runite_allocator_t* allocator);
+
 bool archive_decompress(archive_t* archive, file_t* data);
+bool archive_decompress_begin(archive_decoder_t* decoder, archive_t* archive, file_t* data);
+int archive_decompress_step(archive_decoder_t* decoder, uint32_t budget_us);
 bool archive_compress(archive_t* archive, file_t* out_file, uint8_t scheme);
 
+bool archive_decompress_batch(thread_pool_t* pool, archive_t** archives, file_t* inputs, size_t count, bool* results);
+bool archive_compress_batch(thread_pool_t* pool, archive_t** archives, uint8_t* schemes, file_t* outputs, size_t count, bool* results);
+
 archive_file_t* archive_add_file(archive_t* archive, jhash_t identifier, file_t* file);
+archive_file_t* archive_ref_file(archive_t* archive, jhash_t identifier, file_t* file);
 void archive_remove_file(archive_t* archive, archive_file_t* file);
+bool archive_detach_file(archive_t* archive, archive_file_t* file, file_t* out_file);
 archive_file_t* archive_get_file(archive_t* archive, jhash_t identifier);
 
 #endif /* _ARCHIVE_H_ */
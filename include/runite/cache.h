@@ -23,24 +23,63 @@
 #include <stdlib.h>
 
 #include <runite/util/object.h>
+#include <runite/util/allocator.h>
+#include <runite/util/thread_pool.h>
 #include <runite/file.h>
 
+#define CACHE_LOAD_CONTIGUOUS (1 << 0)
+#define CACHE_LOAD_HUGEPAGES  (1 << 1)
+#define CACHE_LOAD_METADATA   (1 << 2)
+#define CACHE_LOAD_STREAM     (1 << 3)
+
+#define CACHE_OK            0
+#define CACHE_ERROR_OPEN   -1
+#define CACHE_ERROR_READ   -2
+#define CACHE_ERROR_MEMORY -3
+#define CACHE_ERROR_FORMAT -4
+
 typedef struct cache cache_t;
+typedef struct cache_meta cache_meta_t;
+typedef struct cache_dat cache_dat_t;
+
+/**
+ * An index's file metadata, as parallel arrays indexed by file id so that
+ * scans over one field stay dense. crcs and versions are NULL until they
+ * are generated or set.
+ */
+struct cache_meta {
+	uint32_t* lengths;
+	uint32_t* sectors;
+	uint32_t* crcs;
+	uint16_t* versions;
+};
 
 struct cache {
 	object_t object;
+	runite_allocator_t* allocator;
+	int load_flags;
 	int num_indices;
 	int* num_files;
 	bool must_free;
 	file_t** files;
+	file_buffer_t** indices;
+	cache_meta_t* meta;
+	cache_dat_t* dat;
 };
 
 extern object_proto_t cache_proto;
 
+bool cache_set_allocator(cache_t* cache, runite_allocator_t* allocator);
+bool cache_set_load_flags(cache_t* cache, int flags);
 int cache_open_fs_dir(cache_t* cache, const char* directory);
-void cache_open_fs(cache_t* cache, int num_indices, const char** index_files, const char* data_file);
+int cache_open_fs(cache_t* cache, int num_indices, const char** index_files, const char* data_file);
 
 file_t* cache_get_file(cache_t* cache, int index, int file);
+bool cache_read_file(cache_t* cache, int index, int file, file_t* out);
+cache_meta_t* cache_get_meta(cache_t* cache, int index);
+bool cache_set_versions(cache_t* cache, int index, const uint16_t* versions, int count);
+uint64_t cache_index_size(cache_t* cache, int index);
 void cache_gen_crc(cache_t* cache, int index, file_t* file);
+void cache_gen_crc_parallel(thread_pool_t* pool, cache_t* cache, int index, file_t* file);
 
 #endif /* _CACHE_H_ */
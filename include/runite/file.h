@@ -21,13 +21,66 @@
 #include <stdlib.h>
 #include <stdbool.h>
 
+#include <runite/util/allocator.h>
+#include <runite/util/thread_pool.h>
+
+#define FILE_MAPPED   (1 << 0)
+#define FILE_BORROWED (1 << 1)
+#define FILE_SHARED   (1 << 2)
+
 typedef struct file file_t;
+typedef struct file_buffer file_buffer_t;
+
+typedef void (*file_buffer_release_t)(file_buffer_t* buffer);
+
+/**
+ * A reference counted block of file contents, shared by every file_t
+ * that refers into it. The contents are released with the last reference,
+ * or handed to release, for a buffer embedded in whatever owns them.
+ */
+struct file_buffer {
+	int refs;
+	size_t length;
+	unsigned char* data;
+	runite_allocator_t* allocator;
+	int flags;
+	file_buffer_release_t release;
+};
+
+/**
+ * A file's contents. allocator is where data came from, or NULL if it was
+ * allocated with malloc. flags says how file_free should release data:
+ * FILE_MAPPED data is unmapped, FILE_BORROWED data belongs to something
+ * else (an archive's arena, a cache's slab) and is left alone, and
+ * FILE_SHARED data lies within buffer, which holds a reference for this
+ * file. A borrowed file's buffer is NULL, unless its owner keeps the data
+ * in one, in which case the file holds no reference but file_ref and
+ * file_slice can take one. Shared and borrowed files have no allocator,
+ * so the two share a field.
+ */
 struct file {
 	size_t length;
 	unsigned char* data;
+	union {
+		runite_allocator_t* allocator;
+		file_buffer_t* buffer;
+	};
+	int flags;
 };
 
 bool file_read(file_t* file, const char* path);
+bool file_map(file_t* file, const char* path);
+bool file_read_batch(thread_pool_t* pool, file_t* files, const char** paths, size_t count, bool* results);
+void file_free(file_t* file);
+
+bool file_share(file_t* file);
+bool file_ref(file_t* out, file_t* file);
+bool file_slice(file_t* out, file_t* file, size_t offset, size_t length);
+
+file_buffer_t* file_buffer_new(unsigned char* data, size_t length, runite_allocator_t* allocator, int flags);
+void file_buffer_init(file_buffer_t* buffer, unsigned char* data, size_t length, file_buffer_release_t release);
+file_buffer_t* file_buffer_acquire(file_buffer_t* buffer);
+void file_buffer_release(file_buffer_t* buffer);
 bool file_write(file_t* file, const char* path);
 void file_path_join(char* path_a, char* path_b, char* out);
 
@@ -0,0 +1,67 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * allocator.h
+ *
+ * Pluggable memory allocation for buffers (codec data, file contents,
+ * arena chunks, bzlib state). An allocator is a set of hooks plus the
+ * byte counters kept for it, so memory can be bounded and attributed per
+ * subsystem. Memory must be freed through the allocator it came from,
+ * with the size it was allocated with.
+ */
+
+#ifndef _ALLOCATOR_H_
+#define _ALLOCATOR_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct runite_allocator runite_allocator_t;
+
+typedef void* (*runite_alloc_t)(void* ctx, size_t size);
+typedef void* (*runite_realloc_t)(void* ctx, void* ptr, size_t old_size, size_t size);
+typedef void (*runite_free_t)(void* ctx, void* ptr, size_t size);
+
+struct runite_allocator {
+	runite_alloc_t alloc;
+	runite_realloc_t realloc;
+	runite_free_t free;
+	void* ctx;
+	size_t limit;
+	size_t bytes_in_use;
+	size_t bytes_high_water;
+	size_t num_allocs;
+};
+
+void runite_allocator_init(runite_allocator_t* allocator, runite_alloc_t alloc, runite_realloc_t realloc, runite_free_t free, void* ctx);
+void runite_allocator_set_limit(runite_allocator_t* allocator, size_t limit);
+size_t runite_allocator_in_use(runite_allocator_t* allocator);
+size_t runite_allocator_high_water(runite_allocator_t* allocator);
+
+runite_allocator_t* runite_allocator_default();
+runite_allocator_t* runite_allocator_get();
+void runite_allocator_set(runite_allocator_t* allocator);
+
+void* runite_alloc(runite_allocator_t* allocator, size_t size);
+void* runite_realloc(runite_allocator_t* allocator, void* ptr, size_t old_size, size_t size);
+void runite_free(runite_allocator_t* allocator, void* ptr, size_t size);
+
+void* runite_bzalloc(void* allocator, int items, int size);
+void runite_bzfree(void* allocator, void* ptr);
+
+#endif /* _ALLOCATOR_H_ */
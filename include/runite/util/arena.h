@@ -0,0 +1,65 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <runite/util/config.h>
+#include <runite/util/object.h>
+#include <runite/util/allocator.h>
+
+#define ARENA_ALIGN sizeof(uint64_t)
+#define ARENA_ROUND(x) (((x) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+typedef struct arena arena_t;
+typedef struct arena_chunk arena_chunk_t;
+typedef struct arena_block arena_block_t;
+
+struct arena_chunk {
+	arena_chunk_t* next;
+	size_t size;
+	size_t used;
+	unsigned char data[] __attribute__((aligned(ARENA_ALIGN)));
+};
+
+/**
+ * A released allocation, waiting on the free list to be handed out again
+ */
+struct arena_block {
+	arena_block_t* next;
+	size_t size;
+};
+
+struct arena {
+	object_t object;
+	runite_allocator_t* allocator;
+	arena_chunk_t* head;
+	arena_block_t* free_list;
+	size_t chunk_size;
+};
+
+extern object_proto_t arena_proto;
+
+void* arena_alloc(arena_t* arena, size_t size);
+void arena_release(arena_t* arena, void* ptr, size_t size);
+void arena_reserve(arena_t* arena, size_t size);
+void arena_reset(arena_t* arena);
+
+#endif /* _ARENA_H_ */
@@ -26,16 +26,23 @@
 
 #include <runite/util/config.h>
 #include <runite/util/object.h>
+#include <runite/util/allocator.h>
 
 typedef struct codec codec_t;
 
 struct codec {
 	object_t object;
+	runite_allocator_t* allocator;
 	unsigned char* data;
 	size_t length;
+	size_t size;
 	size_t caret;
 	bool bit_access_mode;
 	size_t bit_caret;
+	bool growable;
+	bool read_only;
+	bool borrowed;
+	bool overflow;
 };
 
 extern object_proto_t codec_proto;
@@ -49,7 +56,14 @@ extern object_proto_t codec_proto;
 #define CODEC_MIDDLE_B  (1 << 5)
 #define CODEC_JSTRING  (1 << 6)
 
+void codec_wrap(codec_t* codec, void* data, size_t len);
+void codec_view(codec_t* codec, const void* data, size_t len);
 void codec_resize(codec_t* codec, size_t size);
+bool codec_set_allocator(codec_t* codec, runite_allocator_t* allocator);
+void codec_set_growable(codec_t* codec, bool growable);
+bool codec_reserve(codec_t* codec, size_t capacity);
+bool codec_grow(codec_t* codec, size_t n);
+void codec_shrink(codec_t* codec);
 void codec_seek(codec_t* codec, size_t caret);
 size_t codec_len(codec_t* codec);
 
@@ -74,6 +88,13 @@ void codec_put32f(codec_t* codec, uint32_t i, uint8_t flags);
 void codec_put64f(codec_t* codec, uint64_t i, uint8_t flags);
 void codec_puts(codec_t* codec, char* s, int len, uint8_t flags);
 
+bool codec_put16_array(codec_t* codec, const uint16_t* in, size_t n, uint8_t flags);
+bool codec_put32_array(codec_t* codec, const uint32_t* in, size_t n, uint8_t flags);
+
+void codec_put_smart(codec_t* codec, uint16_t i);
+void codec_put_signed_smart(codec_t* codec, int16_t i);
+void codec_put_big_smart(codec_t* codec, uint32_t i);
+
 uint8_t codec_get8(codec_t* codec);
 uint16_t codec_get16(codec_t* codec);
 uint32_t codec_get24(codec_t* codec);
@@ -88,4 +109,13 @@ uint32_t codec_get32fp(codec_t* codec, uint32_t* i, uint8_t flags);
 uint64_t codec_get64fp(codec_t* codec, uint64_t* i, uint8_t flags);
 char* codec_gets(codec_t* codec, char* s, int len, uint8_t flags);
 
+bool codec_get16_array(codec_t* codec, uint16_t* out, size_t n, uint8_t flags);
+bool codec_get32_array(codec_t* codec, uint32_t* out, size_t n, uint8_t flags);
+
+uint16_t codec_get_smart(codec_t* codec);
+int16_t codec_get_signed_smart(codec_t* codec);
+uint32_t codec_get_big_smart(codec_t* codec);
+bool codec_get_smart_array(codec_t* codec, int32_t* out, size_t n);
+bool codec_get_signed_smart_array(codec_t* codec, int32_t* out, size_t n);
+
 #endif /* _STREAM_CODEC_H_ */
@@ -0,0 +1,64 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * codec_chain.h
+ *
+ * An ordered list of buffers which are written out together with one
+ * writev/sendmsg, without first being copied into a single codec. Segments
+ * are either owned codecs, which the chain frees once they are sent,
+ * shared files, which the chain holds a reference to until then, or
+ * borrowed memory which must stay valid until then.
+ */
+
+#ifndef _CODEC_CHAIN_H_
+#define _CODEC_CHAIN_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <runite/file.h>
+#include <runite/util/object.h>
+#include <runite/util/codec.h>
+
+typedef struct codec_chain codec_chain_t;
+
+struct codec_chain {
+	object_t object;
+	struct iovec* iov;
+	codec_t** owned;
+	file_buffer_t** shared;
+	size_t num_segments;
+	size_t capacity;
+	size_t head;
+	size_t head_ofs;
+	size_t remaining;
+};
+
+extern object_proto_t codec_chain_proto;
+
+bool codec_chain_add_codec(codec_chain_t* chain, codec_t* codec, bool owned);
+bool codec_chain_add_buffer(codec_chain_t* chain, const void* data, size_t len);
+bool codec_chain_add_file(codec_chain_t* chain, file_t* file);
+size_t codec_chain_len(codec_chain_t* chain);
+ssize_t codec_chain_write(codec_chain_t* chain, int fd);
+ssize_t codec_chain_send(codec_chain_t* chain, int fd, int flags);
+void codec_chain_reset(codec_chain_t* chain);
+
+#endif /* _CODEC_CHAIN_H_ */
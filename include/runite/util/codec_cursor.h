@@ -0,0 +1,211 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * codec_cursor.h
+ *
+ * A read position over an immutable buffer, kept on the caller's stack.
+ * Any number of cursors (and threads) can decode the same buffer at once
+ * since the buffer itself is never touched. Decoding follows the codec_t
+ * rules: out of bounds gets return 0 and leave the cursor where it is.
+ */
+
+#ifndef _CODEC_CURSOR_H_
+#define _CODEC_CURSOR_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <runite/util/codec.h>
+#include <runite/util/codec_fast.h>
+#include <runite/util/codec_variants.h>
+
+typedef struct codec_cursor codec_cursor_t;
+
+struct codec_cursor {
+	const unsigned char* data;
+	const unsigned char* end;
+	const unsigned char* pos;
+};
+
+/**
+ * Initializes a cursor at the start of a buffer
+ */
+static inline void codec_cursor_init(codec_cursor_t* cursor, const void* data, size_t len)
+{
+	cursor->data = (const unsigned char*)data;
+	cursor->end = cursor->data + len;
+	cursor->pos = cursor->data;
+}
+
+/**
+ * Initializes a cursor over a codec's valid data, starting at its caret
+ * The codec must not be written to while the cursor is in use.
+ */
+static inline void codec_cursor_from(codec_cursor_t* cursor, codec_t* codec)
+{
+	codec_cursor_init(cursor, codec->data, codec_len(codec));
+	cursor->pos = cursor->data + (codec->caret < codec_len(codec) ? codec->caret : codec_len(codec));
+}
+
+static inline size_t codec_cursor_tell(const codec_cursor_t* cursor)
+{
+	return cursor->pos - cursor->data;
+}
+
+static inline size_t codec_cursor_remaining(const codec_cursor_t* cursor)
+{
+	return cursor->end - cursor->pos;
+}
+
+static inline bool codec_cursor_has(const codec_cursor_t* cursor, size_t n)
+{
+	return n <= codec_cursor_remaining(cursor);
+}
+
+/**
+ * Moves a cursor to a given offset from the start of its buffer
+ * returns: Whether the offset was in range
+ */
+static inline bool codec_cursor_seek(codec_cursor_t* cursor, size_t pos)
+{
+	if (pos > (size_t)(cursor->end - cursor->data)) {
+		return false;
+	}
+	cursor->pos = cursor->data + pos;
+	return true;
+}
+
+/* unchecked gets, only valid after a successful codec_cursor_has */
+static inline uint8_t codec_cursor_get8_fast(codec_cursor_t* cursor)
+{
+	return *cursor->pos++;
+}
+
+static inline uint16_t codec_cursor_get16_fast(codec_cursor_t* cursor)
+{
+	uint16_t i = codec_load16(cursor->pos);
+	cursor->pos += 2;
+	return i;
+}
+
+static inline uint32_t codec_cursor_get24_fast(codec_cursor_t* cursor)
+{
+	uint32_t i = codec_load24(cursor->pos);
+	cursor->pos += 3;
+	return i;
+}
+
+static inline uint32_t codec_cursor_get32_fast(codec_cursor_t* cursor)
+{
+	uint32_t i = codec_load32(cursor->pos);
+	cursor->pos += 4;
+	return i;
+}
+
+static inline uint64_t codec_cursor_get64_fast(codec_cursor_t* cursor)
+{
+	uint64_t i = codec_load64(cursor->pos);
+	cursor->pos += 8;
+	return i;
+}
+
+/* checked gets with modifier flags, see codec_get*fp */
+static inline uint8_t codec_cursor_get8f(codec_cursor_t* cursor, uint8_t flags)
+{
+	if (!codec_cursor_has(cursor, 1)) {
+		return 0;
+	}
+	return codec_xform_flags(codec_cursor_get8_fast(cursor), flags);
+}
+
+static inline uint16_t codec_cursor_get16f(codec_cursor_t* cursor, uint8_t flags)
+{
+	if (!codec_cursor_has(cursor, 2)) {
+		return 0;
+	}
+	uint16_t i = codec_cursor_get16_fast(cursor);
+	return codec_xform_flags(flags & CODEC_LITTLE ? codec_order_le16(i) : i, flags);
+}
+
+static inline uint32_t codec_cursor_get24f(codec_cursor_t* cursor, uint8_t flags)
+{
+	if (!codec_cursor_has(cursor, 3)) {
+		return 0;
+	}
+	uint32_t i = codec_cursor_get24_fast(cursor);
+	return codec_xform_flags(flags & CODEC_LITTLE ? codec_order_le24(i) : i, flags);
+}
+
+static inline uint32_t codec_cursor_get32f(codec_cursor_t* cursor, uint8_t flags)
+{
+	if (!codec_cursor_has(cursor, 4)) {
+		return 0;
+	}
+	return codec_xform_flags(codec_order_flags32(codec_cursor_get32_fast(cursor), flags), flags);
+}
+
+static inline uint64_t codec_cursor_get64f(codec_cursor_t* cursor, uint8_t flags)
+{
+	if (!codec_cursor_has(cursor, 8)) {
+		return 0;
+	}
+	uint64_t i = codec_cursor_get64_fast(cursor);
+	return codec_xform_flags(flags & CODEC_LITTLE ? codec_order_le64(i) : i, flags);
+}
+
+static inline uint8_t codec_cursor_get8(codec_cursor_t* cursor)
+{
+	return codec_cursor_get8f(cursor, 0);
+}
+
+static inline uint16_t codec_cursor_get16(codec_cursor_t* cursor)
+{
+	return codec_cursor_get16f(cursor, 0);
+}
+
+static inline uint32_t codec_cursor_get24(codec_cursor_t* cursor)
+{
+	return codec_cursor_get24f(cursor, 0);
+}
+
+static inline uint32_t codec_cursor_get32(codec_cursor_t* cursor)
+{
+	return codec_cursor_get32f(cursor, 0);
+}
+
+static inline uint64_t codec_cursor_get64(codec_cursor_t* cursor)
+{
+	return codec_cursor_get64f(cursor, 0);
+}
+
+/**
+ * Copies len bytes out of the buffer
+ * returns: data, or NULL if there weren't len bytes left
+ */
+static inline unsigned char* codec_cursor_getn(codec_cursor_t* cursor, unsigned char* data, size_t len)
+{
+	if (!codec_cursor_has(cursor, len)) {
+		return NULL;
+	}
+	memcpy(data, cursor->pos, len);
+	cursor->pos += len;
+	return data;
+}
+
+#endif /* _CODEC_CURSOR_H_ */
@@ -0,0 +1,186 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * codec_fast.h
+ *
+ * Unchecked big endian accessors for codec_t. The caller validates the
+ * space for a run of fields once with codec_has (or codec_ensure when
+ * writing), after which each access is a plain load/store plus a byte swap.
+ * Assumes little endian native order.
+ */
+
+#ifndef _CODEC_FAST_H_
+#define _CODEC_FAST_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <runite/util/codec.h>
+
+/* raw big endian loads and stores */
+static inline uint16_t codec_load16(const unsigned char* p)
+{
+	uint16_t i;
+	memcpy(&i, p, 2);
+	return __builtin_bswap16(i);
+}
+
+static inline uint32_t codec_load24(const unsigned char* p)
+{
+	return ((uint32_t)codec_load16(p) << 8) | p[2];
+}
+
+static inline uint32_t codec_load32(const unsigned char* p)
+{
+	uint32_t i;
+	memcpy(&i, p, 4);
+	return __builtin_bswap32(i);
+}
+
+static inline uint64_t codec_load64(const unsigned char* p)
+{
+	uint64_t i;
+	memcpy(&i, p, 8);
+	return __builtin_bswap64(i);
+}
+
+static inline void codec_store16(unsigned char* p, uint16_t i)
+{
+	i = __builtin_bswap16(i);
+	memcpy(p, &i, 2);
+}
+
+static inline void codec_store24(unsigned char* p, uint32_t i)
+{
+	codec_store16(p, i >> 8);
+	p[2] = i;
+}
+
+static inline void codec_store32(unsigned char* p, uint32_t i)
+{
+	i = __builtin_bswap32(i);
+	memcpy(p, &i, 4);
+}
+
+static inline void codec_store64(unsigned char* p, uint64_t i)
+{
+	i = __builtin_bswap64(i);
+	memcpy(p, &i, 8);
+}
+
+/**
+ * Checks that n bytes can be accessed from the caret
+ */
+static inline bool codec_has(codec_t* codec, size_t n)
+{
+	return n <= codec->length && codec->caret <= codec->length - n;
+}
+
+/**
+ * Checks that n bytes can be written from the caret, growing the buffer
+ * if the codec is growable. Always fails for read only codecs. A failure
+ * sets the codec's overflow flag, so that writes which were dropped can
+ * be noticed afterwards.
+ */
+static inline bool codec_ensure(codec_t* codec, size_t n)
+{
+	if (!codec->read_only && (codec_has(codec, n) || (codec->growable && codec_grow(codec, n)))) {
+		return true;
+	}
+	codec->overflow = true;
+	return false;
+}
+
+/**
+ * Extends the valid data to cover everything up to the caret
+ */
+static inline void codec_mark(codec_t* codec)
+{
+	codec->size = codec->caret > codec->size ? codec->caret : codec->size;
+}
+
+/* unchecked accessors, only valid after a successful codec_has or codec_ensure */
+static inline uint8_t codec_get8_fast(codec_t* codec)
+{
+	return codec->data[codec->caret++];
+}
+
+static inline uint16_t codec_get16_fast(codec_t* codec)
+{
+	uint16_t i = codec_load16(codec->data + codec->caret);
+	codec->caret += 2;
+	return i;
+}
+
+static inline uint32_t codec_get24_fast(codec_t* codec)
+{
+	uint32_t i = codec_load24(codec->data + codec->caret);
+	codec->caret += 3;
+	return i;
+}
+
+static inline uint32_t codec_get32_fast(codec_t* codec)
+{
+	uint32_t i = codec_load32(codec->data + codec->caret);
+	codec->caret += 4;
+	return i;
+}
+
+static inline uint64_t codec_get64_fast(codec_t* codec)
+{
+	uint64_t i = codec_load64(codec->data + codec->caret);
+	codec->caret += 8;
+	return i;
+}
+
+static inline void codec_put8_fast(codec_t* codec, uint8_t i)
+{
+	codec->data[codec->caret++] = i;
+	codec_mark(codec);
+}
+
+static inline void codec_put16_fast(codec_t* codec, uint16_t i)
+{
+	codec_store16(codec->data + codec->caret, i);
+	codec->caret += 2;
+	codec_mark(codec);
+}
+
+static inline void codec_put24_fast(codec_t* codec, uint32_t i)
+{
+	codec_store24(codec->data + codec->caret, i);
+	codec->caret += 3;
+	codec_mark(codec);
+}
+
+static inline void codec_put32_fast(codec_t* codec, uint32_t i)
+{
+	codec_store32(codec->data + codec->caret, i);
+	codec->caret += 4;
+	codec_mark(codec);
+}
+
+static inline void codec_put64_fast(codec_t* codec, uint64_t i)
+{
+	codec_store64(codec->data + codec->caret, i);
+	codec->caret += 8;
+	codec_mark(codec);
+}
+
+#endif /* _CODEC_FAST_H_ */
@@ -0,0 +1,82 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * codec_pool.h
+ *
+ * Recycles codecs and their buffers. Codecs are grouped into power of two
+ * size classes starting at DEFAULT_BUFFER_SIZE, and each thread keeps a
+ * small cache per class so most acquires and releases don't take a lock.
+ */
+
+#ifndef _CODEC_POOL_H_
+#define _CODEC_POOL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include <runite/util/object.h>
+#include <runite/util/list.h>
+#include <runite/util/codec.h>
+
+#define CODEC_POOL_NUM_CLASSES 6
+#define CODEC_POOL_CACHE_SIZE 32
+
+typedef struct codec_pool codec_pool_t;
+typedef struct codec_pool_entry codec_pool_entry_t;
+typedef struct codec_pool_cache codec_pool_cache_t;
+typedef struct codec_pool_stats codec_pool_stats_t;
+
+struct codec_pool_entry {
+	codec_t codec;
+	codec_pool_entry_t* next;
+	size_t charged;
+};
+
+struct codec_pool_cache {
+	list_node_t node;
+	codec_pool_t* pool;
+	codec_pool_entry_t* free[CODEC_POOL_NUM_CLASSES];
+	int count[CODEC_POOL_NUM_CLASSES];
+};
+
+struct codec_pool_stats {
+	size_t in_use;
+	size_t in_use_high_water;
+	size_t bytes_in_use;
+	size_t bytes_high_water;
+	size_t acquires;
+	size_t allocations;
+};
+
+struct codec_pool {
+	object_t object;
+	pthread_key_t cache_key;
+	pthread_mutex_t lock;
+	list_t caches;
+	codec_pool_entry_t* free[CODEC_POOL_NUM_CLASSES];
+	codec_pool_stats_t stats;
+};
+
+extern object_proto_t codec_pool_proto;
+
+codec_t* codec_pool_acquire(codec_pool_t* pool, size_t capacity);
+void codec_pool_release(codec_pool_t* pool, codec_t* codec);
+void codec_pool_get_stats(codec_pool_t* pool, codec_pool_stats_t* stats);
+
+#endif /* _CODEC_POOL_H_ */
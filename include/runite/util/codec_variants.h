@@ -0,0 +1,177 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * codec_variants.h
+ *
+ * Straight-line codec accessors specialized for each byte order and
+ * transform, for call sites which use constant modifier flags. Names are
+ * codec_{get,put}<bits>[_order][_transform], eg. codec_get16_le_ofs128:
+ *  - order: le (CODEC_LITTLE), ma (CODEC_MIDDLE_A), mb (CODEC_MIDDLE_B)
+ *  - transform: neg (CODEC_NEGATIVE), inv128 (CODEC_INV128), ofs128 (CODEC_OFS128)
+ * The middle orders only exist for 32 bit values, and 8 bit values only
+ * have transforms. Like the flagged API, out of bounds gets return 0 and
+ * out of bounds puts are dropped.
+ */
+
+#ifndef _CODEC_VARIANTS_H_
+#define _CODEC_VARIANTS_H_
+
+#include <stdint.h>
+
+#include <runite/util/codec.h>
+#include <runite/util/codec_fast.h>
+
+#define CODEC_ORDER_MASK (CODEC_LITTLE | CODEC_MIDDLE_A | CODEC_MIDDLE_B)
+#define CODEC_XFORM_MASK (CODEC_NEGATIVE | CODEC_INV128 | CODEC_OFS128)
+
+/* byte orders, applied after a big endian load or before a big endian store */
+static inline uint64_t codec_order_be(uint64_t i)
+{
+	return i;
+}
+
+static inline uint64_t codec_order_le16(uint64_t i)
+{
+	return __builtin_bswap16(i);
+}
+
+static inline uint64_t codec_order_le24(uint64_t i)
+{
+	return ((i & 0xff) << 16) | (i & 0xff00) | ((i >> 16) & 0xff);
+}
+
+static inline uint64_t codec_order_le32(uint64_t i)
+{
+	return __builtin_bswap32(i);
+}
+
+static inline uint64_t codec_order_le64(uint64_t i)
+{
+	return __builtin_bswap64(i);
+}
+
+static inline uint64_t codec_order_ma32(uint64_t i)
+{
+	/* This is essentially PDP-endian */
+	uint32_t x = i;
+	return ((x & 0x00ff00ff) << 8) | ((x >> 8) & 0x00ff00ff);
+}
+
+static inline uint64_t codec_order_mb32(uint64_t i)
+{
+	/* The reverse of MIDDLE_A */
+	uint32_t x = i;
+	return (x << 16) | (x >> 16);
+}
+
+/**
+ * Applies the 32 bit byte order given by flags
+ * LITTLE takes precedence over MIDDLE_A, which takes precedence over MIDDLE_B
+ */
+static inline uint64_t codec_order_flags32(uint64_t i, uint8_t flags)
+{
+	if (flags & CODEC_LITTLE) {
+		return codec_order_le32(i);
+	} else if (flags & CODEC_MIDDLE_A) {
+		return codec_order_ma32(i);
+	} else if (flags & CODEC_MIDDLE_B) {
+		return codec_order_mb32(i);
+	}
+	return i;
+}
+
+/* transforms on the least significant byte, the same for gets and puts */
+static inline uint64_t codec_xform_none(uint64_t i)
+{
+	return i;
+}
+
+static inline uint64_t codec_xform_neg(uint64_t i)
+{
+	return (i & ~(uint64_t)0xff) | (uint8_t)-i;
+}
+
+static inline uint64_t codec_xform_inv128(uint64_t i)
+{
+	return (i & ~(uint64_t)0xff) | (uint8_t)(128 - i);
+}
+
+static inline uint64_t codec_xform_ofs128(uint64_t i)
+{
+	return i ^ 0x80;
+}
+
+/**
+ * Applies every transform in flags in turn, for unusual flag combinations
+ */
+static inline uint64_t codec_xform_flags(uint64_t i, uint8_t flags)
+{
+	if (flags & CODEC_NEGATIVE) {
+		i = codec_xform_neg(i);
+	}
+	if (flags & CODEC_INV128) {
+		i = codec_xform_inv128(i);
+	}
+	if (flags & CODEC_OFS128) {
+		i = codec_xform_ofs128(i);
+	}
+	return i;
+}
+
+#define CODEC_DEFINE_VARIANT(bits, type, suffix, order, xform)			\
+	static inline type codec_get##bits##suffix(codec_t* codec)			\
+	{																	\
+		if (!codec_has(codec, (bits)/8)) {								\
+			return 0;													\
+		}																\
+		return (type)xform(order(codec_get##bits##_fast(codec)));		\
+	}																	\
+	static inline void codec_put##bits##suffix(codec_t* codec, type i)	\
+	{																	\
+		if (!codec_ensure(codec, (bits)/8)) {							\
+			return;														\
+		}																\
+		codec_put##bits##_fast(codec, (type)order(xform(i)));			\
+	}
+
+#define CODEC_DEFINE_XFORMS(bits, type, order_suffix, order)				\
+	CODEC_DEFINE_VARIANT(bits, type, order_suffix##_neg, order, codec_xform_neg) \
+	CODEC_DEFINE_VARIANT(bits, type, order_suffix##_inv128, order, codec_xform_inv128) \
+	CODEC_DEFINE_VARIANT(bits, type, order_suffix##_ofs128, order, codec_xform_ofs128)
+
+#define CODEC_DEFINE_ORDER(bits, type, order_suffix, order)				\
+	CODEC_DEFINE_VARIANT(bits, type, order_suffix, order, codec_xform_none) \
+	CODEC_DEFINE_XFORMS(bits, type, order_suffix, order)
+
+CODEC_DEFINE_XFORMS(8, uint8_t, , codec_order_be)
+
+CODEC_DEFINE_XFORMS(16, uint16_t, , codec_order_be)
+CODEC_DEFINE_ORDER(16, uint16_t, _le, codec_order_le16)
+
+CODEC_DEFINE_XFORMS(24, uint32_t, , codec_order_be)
+CODEC_DEFINE_ORDER(24, uint32_t, _le, codec_order_le24)
+
+CODEC_DEFINE_XFORMS(32, uint32_t, , codec_order_be)
+CODEC_DEFINE_ORDER(32, uint32_t, _le, codec_order_le32)
+CODEC_DEFINE_ORDER(32, uint32_t, _ma, codec_order_ma32)
+CODEC_DEFINE_ORDER(32, uint32_t, _mb, codec_order_mb32)
+
+CODEC_DEFINE_XFORMS(64, uint64_t, , codec_order_be)
+CODEC_DEFINE_ORDER(64, uint64_t, _le, codec_order_le64)
+
+#endif /* _CODEC_VARIANTS_H_ */
@@ -19,5 +19,7 @@
 #define _RUNITE_CONFIG_H_
 
 #define DEFAULT_BUFFER_SIZE 4096
+#define DEFAULT_ARENA_CHUNK_SIZE (64*1024)
+#define DEFAULT_SLAB_CHUNK_SIZE (64*1024)
 
 #endif /* _RUNITE_CONFIG_H_ */
@@ -0,0 +1,49 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * futex.h
+ *
+ * A wait/signal event for the lock-free queues. Waiters read the sequence,
+ * re-check their condition and sleep until the sequence moves on, so a
+ * signal between the check and the sleep is never lost. Signalling is a
+ * fence and a load unless somebody is actually waiting.
+ */
+
+#ifndef _FUTEX_H_
+#define _FUTEX_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct futex_event futex_event_t;
+
+struct futex_event {
+	uint32_t seq;
+	uint32_t waiters;
+};
+
+void futex_event_init(futex_event_t* event);
+uint32_t futex_event_prepare(futex_event_t* event);
+bool futex_event_wait(futex_event_t* event, uint32_t seq, int timeout_ms);
+void futex_event_cancel(futex_event_t* event);
+void futex_event_signal(futex_event_t* event);
+
+int64_t futex_deadline(int timeout_ms);
+int futex_remaining(int64_t deadline);
+
+#endif /* _FUTEX_H_ */
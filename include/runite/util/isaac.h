@@ -0,0 +1,69 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * isaac.h
+ *
+ * The ISAAC stream cipher, as used to encrypt packet opcodes. Keystream is
+ * generated ISAAC_SIZE words at a time and handed out from the end of the
+ * batch, in the same order as the client.
+ */
+
+#ifndef _ISAAC_H_
+#define _ISAAC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <runite/util/object.h>
+#include <runite/util/codec.h>
+
+#define ISAAC_SIZE 256
+
+typedef struct isaac isaac_t;
+
+struct isaac {
+	object_t object;
+	uint32_t results[ISAAC_SIZE];
+	uint32_t mem[ISAAC_SIZE];
+	uint32_t a;
+	uint32_t b;
+	uint32_t c;
+	int count;
+};
+
+extern object_proto_t isaac_proto;
+
+void isaac_seed(isaac_t* isaac, const uint32_t* seed, size_t len);
+void isaac_generate(isaac_t* isaac);
+
+/**
+ * Takes the next keystream value, generating a new batch when the current
+ * one runs out
+ */
+static inline uint32_t isaac_next(isaac_t* isaac)
+{
+	if (isaac->count == 0) {
+		isaac_generate(isaac);
+	}
+	return isaac->results[--isaac->count];
+}
+
+void codec_put_opcode(codec_t* codec, isaac_t* isaac, uint8_t opcode);
+uint8_t codec_get_opcode(codec_t* codec, isaac_t* isaac);
+
+#endif /* _ISAAC_H_ */
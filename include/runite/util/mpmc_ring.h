@@ -0,0 +1,61 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * mpmc_ring.h
+ *
+ * A bounded lock-free FIFO of pointers for any number of producer and
+ * consumer threads. Pushes fail rather than block when the ring is full.
+ */
+
+#ifndef _MPMC_RING_H_
+#define _MPMC_RING_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <runite/util/object.h>
+#include <runite/util/futex.h>
+
+typedef struct mpmc_ring mpmc_ring_t;
+typedef struct mpmc_cell mpmc_cell_t;
+
+struct mpmc_cell {
+	size_t seq;
+	void* item;
+};
+
+struct mpmc_ring {
+	object_t object;
+	mpmc_cell_t* cells;
+	size_t mask;
+	char pad0[64];
+	size_t enqueue_pos;
+	char pad1[64];
+	size_t dequeue_pos;
+	char pad2[64];
+	futex_event_t event;
+};
+
+extern object_proto_t mpmc_ring_proto;
+
+bool mpmc_ring_alloc(mpmc_ring_t* ring, size_t capacity);
+bool mpmc_ring_push(mpmc_ring_t* ring, void* item);
+void* mpmc_ring_pop(mpmc_ring_t* ring);
+void* mpmc_ring_pop_wait(mpmc_ring_t* ring, int timeout_ms);
+
+#endif /* _MPMC_RING_H_ */
@@ -0,0 +1,54 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * mpsc_queue.h
+ *
+ * An intrusive lock-free FIFO for many producer threads and a single
+ * consumer thread. Items embed a list_node_t like queue_t, though only
+ * its next pointer is used while queued.
+ */
+
+#ifndef _MPSC_QUEUE_H_
+#define _MPSC_QUEUE_H_
+
+#include <stdbool.h>
+
+#include <runite/util/object.h>
+#include <runite/util/container_of.h>
+#include <runite/util/list.h>
+#include <runite/util/futex.h>
+
+typedef struct mpsc_queue mpsc_queue_t;
+
+struct mpsc_queue {
+	object_t object;
+	list_node_t* head;
+	char pad[64];
+	list_node_t* tail;
+	list_node_t stub;
+	futex_event_t event;
+};
+
+extern object_proto_t mpsc_queue_proto;
+
+void mpsc_queue_push(mpsc_queue_t* queue, list_node_t* item);
+list_node_t* mpsc_queue_pop(mpsc_queue_t* queue);
+list_node_t* mpsc_queue_pop_wait(mpsc_queue_t* queue, int timeout_ms);
+bool mpsc_queue_empty(mpsc_queue_t* queue);
+
+#endif /* _MPSC_QUEUE_H_ */
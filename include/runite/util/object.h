@@ -20,29 +20,46 @@
 
 #include <stdbool.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 typedef struct object_proto object_proto_t;
 typedef struct object object_t;
+typedef struct object_slab object_slab_t;
 
 typedef void (*object_init_t)(void*);
 typedef void (*object_free_t)(void*);
 
+/**
+ * Shared free lists for one object type, see object.c
+ * Declare with OBJECT_SLAB_INITIALIZER and point the type's prototype at it.
+ */
+struct object_slab {
+	pthread_mutex_t lock;
+	int id;
+	size_t size;
+	void* free;
+	void* chunks;
+};
+
+#define OBJECT_SLAB_INITIALIZER { .lock = PTHREAD_MUTEX_INITIALIZER }
+
 struct object_proto {
 	object_init_t init;
 	object_free_t free;
+	object_slab_t* slab;
 };
 
 struct object {
-	object_proto_t prototype;
+	const object_proto_t* prototype;
 	bool must_free;
 };
 
-object_t* _object_new(object_proto_t proto, size_t size);
-void _object_init(object_proto_t proto, object_t* object);
+object_t* _object_new(const object_proto_t* proto, size_t size);
+void _object_init(const object_proto_t* proto, object_t* object);
 void _object_free(object_t* object);
 
-#define object_new(type) (type##_t*)_object_new(type##_proto, sizeof(type##_t))
-#define object_init(type, object) _object_init(type##_proto, (object_t*)object)
+#define object_new(type) (type##_t*)_object_new(&type##_proto, sizeof(type##_t))
+#define object_init(type, object) _object_init(&type##_proto, (object_t*)object)
 #define object_free(object) _object_free((object_t*)object);
 
 #endif /* _OBJECT_H_ */
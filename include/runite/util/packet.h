@@ -0,0 +1,60 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * packet.h
+ *
+ * Frames packets directly in a codec. The opcode and size slots are
+ * reserved when a packet is begun, the body is written straight after
+ * them, and the slots are filled in when the packet ends. Any number of
+ * packets can be appended to the same (usually growable) codec and sent
+ * with a single write.
+ */
+
+#ifndef _PACKET_H_
+#define _PACKET_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <runite/util/codec.h>
+#include <runite/util/isaac.h>
+
+#define PACKET_FIXED 0
+#define PACKET_VAR_BYTE 1
+#define PACKET_VAR_SHORT 2
+
+typedef struct packet packet_t;
+
+struct packet {
+	codec_t* codec;
+	isaac_t* isaac;
+	size_t start;
+	size_t body;
+	size_t prev_size;
+	bool prev_overflow;
+	uint8_t opcode;
+	int type;
+};
+
+bool packet_begin(packet_t* packet, codec_t* codec, isaac_t* isaac, uint8_t opcode, int type);
+bool packet_end(packet_t* packet);
+void packet_abort(packet_t* packet);
+size_t packet_len(packet_t* packet);
+
+#endif /* _PACKET_H_ */
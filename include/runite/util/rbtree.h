@@ -0,0 +1,72 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * rbtree.h
+ *
+ * An intrusive red-black tree. Embed an rbtree_node_t in each item and
+ * recover the item with container_of, as with list_node_t.
+ */
+
+#ifndef _RBTREE_H_
+#define _RBTREE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <runite/util/object.h>
+#include <runite/util/container_of.h>
+
+#define RBTREE_RED 0
+#define RBTREE_BLACK 1
+
+typedef struct rbtree_node rbtree_node_t;
+typedef struct rbtree rbtree_t;
+typedef int (*rbtree_compare_t)(rbtree_node_t*, rbtree_node_t*);
+
+struct rbtree_node {
+	rbtree_node_t* parent;
+	rbtree_node_t* left;
+	rbtree_node_t* right;
+	int color;
+};
+
+struct rbtree {
+	object_t object;
+	rbtree_node_t* root;
+	rbtree_compare_t compare_func;
+	size_t count;
+};
+
+extern object_proto_t rbtree_proto;
+
+bool rbtree_empty(rbtree_t* tree);
+void rbtree_insert(rbtree_t* tree, rbtree_node_t* node);
+void rbtree_erase(rbtree_t* tree, rbtree_node_t* node);
+rbtree_node_t* rbtree_find(rbtree_t* tree, rbtree_node_t* key);
+
+rbtree_node_t* rbtree_first(rbtree_t* tree);
+rbtree_node_t* rbtree_last(rbtree_t* tree);
+rbtree_node_t* rbtree_next(rbtree_node_t* node);
+rbtree_node_t* rbtree_prev(rbtree_node_t* node);
+
+#define rbtree_for_each(tree)										\
+	for (rbtree_node_t* node_iter = rbtree_first(tree); node_iter != NULL; node_iter = rbtree_next(node_iter))
+
+#define rbtree_for_get(item) item = container_of(node_iter, typeof(*item), node)
+
+#endif /* _RBTREE_H_ */
@@ -32,5 +32,7 @@ struct sorted_list {
 extern object_proto_t sorted_list_proto;
 
 void sorted_list_insert(sorted_list_t* list, list_node_t* node);
+void sorted_list_append(sorted_list_t* list, list_node_t* node);
+void sorted_list_sort(sorted_list_t* list);
 
 #endif /* _SORTED_LIST_H_ */
@@ -0,0 +1,123 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#ifndef _THREAD_POOL_H_
+#define _THREAD_POOL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include <runite/util/object.h>
+
+typedef struct thread_pool thread_pool_t;
+typedef struct thread_worker thread_worker_t;
+typedef struct thread_worker_stats thread_worker_stats_t;
+typedef struct task_group task_group_t;
+typedef struct task task_t;
+typedef struct task_array task_array_t;
+typedef struct task_deque task_deque_t;
+typedef struct task_queue task_queue_t;
+
+typedef void (*task_func_t)(void*);
+typedef void (*range_func_t)(void* arg, size_t begin, size_t end);
+
+struct task {
+	task_func_t func;
+	void* arg;
+	task_group_t* group;
+};
+
+/**
+ * A deque's ring of tasks. Arrays replaced by a grow are kept on the prev
+ * chain until the deque is freed, as a thief may still be reading them.
+ */
+struct task_array {
+	size_t capacity;
+	task_array_t* prev;
+	task_t tasks[];
+};
+
+/**
+ * A Chase-Lev deque. Only the owning worker pushes and pops at bottom;
+ * any thread may steal from top.
+ */
+struct task_deque {
+	long top;
+	char pad0[64];
+	long bottom;
+	task_array_t* array;
+	char pad1[64];
+};
+
+/**
+ * A locked FIFO for tasks submitted from outside the pool
+ */
+struct task_queue {
+	pthread_mutex_t lock;
+	task_t* tasks;
+	size_t head;
+	size_t tail;
+	size_t capacity;
+};
+
+struct thread_worker_stats {
+	uint64_t tasks_run;
+	uint64_t tasks_stolen;
+	uint64_t busy_ns;
+	uint64_t idle_waits;
+};
+
+struct thread_worker {
+	thread_pool_t* pool;
+	pthread_t thread;
+	bool started;
+	int id;
+	int depth;
+	task_deque_t deque;
+	thread_worker_stats_t stats;
+};
+
+struct thread_pool {
+	object_t object;
+	int num_workers;
+	thread_worker_t* workers;
+	task_queue_t injector;
+	int num_queued;
+	bool stopping;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+};
+
+struct task_group {
+	object_t object;
+	int pending;
+	pthread_mutex_t lock;
+	pthread_cond_t done;
+};
+
+extern object_proto_t thread_pool_proto;
+extern object_proto_t task_group_proto;
+
+bool thread_pool_start(thread_pool_t* pool, int num_workers);
+void thread_pool_submit(thread_pool_t* pool, task_group_t* group, task_func_t func, void* arg);
+void thread_pool_parallel_for(thread_pool_t* pool, size_t begin, size_t end, size_t grain, range_func_t func, void* arg);
+bool thread_pool_get_stats(thread_pool_t* pool, int worker, thread_worker_stats_t* stats);
+void task_group_wait(thread_pool_t* pool, task_group_t* group);
+
+#endif /* _THREAD_POOL_H_ */
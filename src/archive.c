@@ -18,6 +18,7 @@
 #include <runite/archive.h>
 
 #include <string.h>
+#include <time.h>
 #include <bzlib.h>
 
 #include <runite/util/math.h>
@@ -26,6 +27,18 @@
 #define BZ2_VERBOSITY 0 /* 0 = silent, 1-4 = verbose */ 
 #define BZ2_WORK_FACTOR 30
 #define BZ2_BUFFER_SIZE 1024*10 
+#define BZ2_SLICE_SIZE (64*1024) /* most bytes inflated between budget checks */
+#define BZ2_COMPRESS_BOUND(len) ((len) + (len)/100 + 600) /* worst case output size */
+
+/* archive_decoder_t states */
+#define DECODER_IDLE 0
+#define DECODER_HEADER 1
+#define DECODER_CONTAINER 2
+#define DECODER_INDEX 3
+#define DECODER_FILE 4
+#define DECODER_FILE_INFLATE 5
+#define DECODER_DONE 6
+#define DECODER_ERROR 7
 
 /**
  * Initializes a new archive_t
@@ -33,28 +46,40 @@
 static void archive_init(archive_t* archive)
 {
 	object_init(list, &archive->files);
+	object_init(arena, &archive->arena);
+	archive->allocator = archive->arena.allocator;
 	archive->num_files = 0;
 }
 
 /**
  * Cleans up an archive_t
+ * Every archive_file_t lives in the archive's arena, so they all go at
+ * once. Shared entries only drop their reference.
  */
 static void archive_free(archive_t* archive)
 {
+	archive_file_t* file;
+	list_for_each(&archive->files) {
+		list_for_get(file);
+		if (file->file.flags & FILE_SHARED) {
+			file_free(&file->file);
+		}
+	}
 	object_free(&archive->files);
+	object_free(&archive->arena);
 }
 
 /**
  * Compresses to a headerless bz2 block
  * Assumes 100k block size
  */
-static bool bz2_headerless_compress(unsigned char* src, uint32_t src_len, unsigned char* dest, uint32_t* dest_len)
+static bool bz2_headerless_compress(runite_allocator_t* allocator, unsigned char* src, uint32_t src_len, unsigned char* dest, uint32_t* dest_len)
 {
 	/* init bzlib */
     bz_stream stream;
-	stream.bzalloc = NULL; 
-	stream.bzfree = NULL;
-	stream.opaque = NULL;
+	stream.bzalloc = runite_bzalloc;
+	stream.bzfree = runite_bzfree;
+	stream.opaque = allocator;
 	int ret = BZ2_bzCompressInit(&stream, 1, BZ2_VERBOSITY, BZ2_WORK_FACTOR);
 	if (ret != BZ_OK) {
 		return false;
@@ -79,7 +104,7 @@ static bool bz2_headerless_compress(unsigned char* src, uint32_t src_len, unsign
 	}
 
 	/* remove the header */
-	memcpy(dest, dest+4, *(dest_len)-4);
+	memmove(dest, dest+4, stream.total_out_lo32-4);
 
 	/* finish up */
 	*dest_len = (stream.total_out_lo32-4);
@@ -94,133 +119,382 @@ success:
 }
 
 /**
- * Decompresses a headerless bz2 block
+ * Incremental inflater for a headerless bz2 block
+ * The 'BZh1' header is fed to bzlib ahead of the source, so the source
+ * is never copied.
+ */
+typedef struct bz2_inflater bz2_inflater_t;
+struct bz2_inflater {
+	bz_stream stream;
+	bool active;
+	unsigned char* src;
+	uint32_t src_len;
+	uint32_t dest_len;
+};
+
+static char bz2_header[] = { 'B', 'Z', 'h', '1' };
+
+/**
+ * Starts inflating a headerless bz2 block
  * Assumes 100k block size
- *  - dest_len: The size of the dest buffer. Contains the amount of data decompressed on successful return
+ *  - dest_len: The size of the dest buffer
  */
-static bool bz2_headerless_decompress(unsigned char* src, uint32_t src_len, unsigned char* dest, uint32_t* dest_len)
+static bool bz2_inflate_begin(bz2_inflater_t* inflater, runite_allocator_t* allocator, unsigned char* src, uint32_t src_len, unsigned char* dest, uint32_t dest_len)
 {
-	/* init bzlib */
-	bz_stream stream;
-	stream.bzalloc = NULL; 
-	stream.bzfree = NULL;
-	stream.opaque = NULL;
-	int ret = BZ2_bzDecompressInit(&stream, BZ2_VERBOSITY, 0);
-	if (ret != BZ_OK) {
+	bz_stream* stream = &inflater->stream;
+	stream->bzalloc = runite_bzalloc;
+	stream->bzfree = runite_bzfree;
+	stream->opaque = allocator;
+	if (BZ2_bzDecompressInit(stream, BZ2_VERBOSITY, 0) != BZ_OK) {
 		return false;
 	}
 
-	unsigned char* bz2_data = (unsigned char*)malloc(src_len+4);
-	/* tack the header on */
-	bz2_data[0] = 'B';
-	bz2_data[1] = 'Z';
-	bz2_data[2] = 'h';
-	bz2_data[3] = '1';
-	memcpy(bz2_data+4, src, src_len);
+	stream->next_in = bz2_header;
+	stream->avail_in = sizeof(bz2_header);
+	stream->next_out = (char*)dest;
+	stream->avail_out = 0;
+	inflater->active = true;
+	inflater->src = src;
+	inflater->src_len = src_len;
+	inflater->dest_len = dest_len;
+	return true;
+}
 
-	/* do the decompress */
-	stream.next_in = (char*)bz2_data;
-	stream.avail_in = src_len+4;
-	stream.next_out = (char*)dest;
-	stream.avail_out = *dest_len;
+/**
+ * Inflates at most BZ2_SLICE_SIZE bytes
+ * returns: BZ_OK if there's more to do, BZ_STREAM_END once finished, or a bzlib error
+ */
+static int bz2_inflate_step(bz2_inflater_t* inflater)
+{
+	bz_stream* stream = &inflater->stream;
+	if (stream->avail_in == 0 && inflater->src != NULL) {
+		/* header consumed, move on to the block itself */
+		stream->next_in = (char*)inflater->src;
+		stream->avail_in = inflater->src_len;
+		inflater->src = NULL;
+	}
 
-	while (ret != BZ_STREAM_END) {
-		ret = BZ2_bzDecompress(&stream);
-		if (ret != BZ_OK && ret != BZ_STREAM_END) {
-			goto error;
-		}
+	unsigned int avail_in = stream->avail_in;
+	unsigned int avail_out = min(inflater->dest_len - stream->total_out_lo32, BZ2_SLICE_SIZE);
+	stream->avail_out = avail_out;
+
+	int ret = BZ2_bzDecompress(stream);
+	if (ret == BZ_OK && stream->avail_in == avail_in && stream->avail_out == avail_out) {
+		/* no progress: either the input is truncated or dest is too small */
+		return BZ_DATA_ERROR;
 	}
+	return ret;
+}
 
-	/* finish up */
-	*dest_len = stream.total_out_lo32;
+/**
+ * Finishes up an inflater
+ */
+static void bz2_inflate_end(bz2_inflater_t* inflater)
+{
+	if (inflater != NULL && inflater->active) {
+		BZ2_bzDecompressEnd(&inflater->stream);
+		inflater->active = false;
+	}
+}
 
-	goto success;
-error:
-	free(bz2_data);
-	BZ2_bzDecompressEnd(&stream);
-	return false;
-success:
-	free(bz2_data);
-	BZ2_bzDecompressEnd(&stream);
-	return true;
+/**
+ * Returns a monotonic timestamp in microseconds
+ */
+static uint64_t archive_clock_us()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
 }
 
 /**
- * Decompresses an archive and loads the contents into memory
+ * Initializes a new archive_decoder_t
  */
-bool archive_decompress(archive_t* archive, file_t* data)
+static void archive_decoder_init(archive_decoder_t* decoder)
 {
-	codec_t* arc_codec = object_new(codec);
-	codec_resize(arc_codec, data->length);
-	codec_putn(arc_codec, data->data, data->length);
-	codec_seek(arc_codec, 0);
-	
-	uint32_t final_len = codec_get24(arc_codec);
-	uint32_t container_len = codec_get24(arc_codec);
-	bool compressed = true;
-
-	if (container_len != final_len) { /* The entire container is compressed */
-		compressed = false;
-
-		/* decompress it */
-		uint32_t decompressed_len = final_len;
-		codec_t* new_codec = object_new(codec);
-		codec_resize(new_codec, final_len);
-		bool success = bz2_headerless_decompress(data->data+6, container_len, new_codec->data, &decompressed_len);
-		if (decompressed_len != final_len) {
-			object_free(new_codec);
-			goto error;
-		}
-		if (!success) {
-			object_free(new_codec);
-			goto error;
+	decoder->archive = NULL;
+	decoder->state = DECODER_IDLE;
+	codec_view(&decoder->codec, NULL, 0);
+	decoder->inflater = NULL;
+	decoder->inflater_allocator = NULL;
+	decoder->progress = 0;
+	decoder->total = 0;
+}
+
+/**
+ * Cleans up an archive_decoder_t
+ */
+static void archive_decoder_free(archive_decoder_t* decoder)
+{
+	bz2_inflate_end((bz2_inflater_t*)decoder->inflater);
+	runite_free(decoder->inflater_allocator, decoder->inflater, sizeof(bz2_inflater_t));
+	object_free(&decoder->codec);
+}
+
+/**
+ * Prepares a decoder to decompress an archive into memory. The archive is
+ * populated by subsequent calls to archive_decompress_step.
+ *  - data: The archive data. Must stay valid until decoding completes
+ */
+bool archive_decompress_begin(archive_decoder_t* decoder, archive_t* archive, file_t* data)
+{
+	bz2_inflate_end((bz2_inflater_t*)decoder->inflater);
+	object_free(&decoder->codec);
+	codec_view(&decoder->codec, NULL, 0);
+
+	/* The inflater comes from the archive's allocator, so it's allocated
+	 * here rather than in archive_decoder_init, and again if a reused
+	 * decoder is handed an archive with a different allocator */
+	runite_allocator_t* allocator = archive->allocator != NULL ? archive->allocator : runite_allocator_get();
+	if (decoder->inflater != NULL && decoder->inflater_allocator != allocator) {
+		runite_free(decoder->inflater_allocator, decoder->inflater, sizeof(bz2_inflater_t));
+		decoder->inflater = NULL;
+	}
+	if (decoder->inflater == NULL) {
+		decoder->inflater = runite_alloc(allocator, sizeof(bz2_inflater_t));
+		if (decoder->inflater == NULL) {
+			decoder->state = DECODER_ERROR;
+			return false;
 		}
+		((bz2_inflater_t*)decoder->inflater)->active = false;
+		decoder->inflater_allocator = allocator;
+	}
 
-		object_free(arc_codec);
-		arc_codec = new_codec;
-	}
-
-	int num_files = codec_get16(arc_codec);
-	int file_ofs = arc_codec->caret + (num_files * 10);
-	for (int i = 0; i < num_files; i++) {
-		/* gather file metadata */
-		archive_file_t* file = (archive_file_t*)malloc(sizeof(archive_file_t));
-		file->identifier = codec_get32(arc_codec);
-		uint32_t final_file_len = codec_get24(arc_codec);
-		uint32_t actual_file_len = codec_get24(arc_codec);
-		if (!compressed && final_file_len != actual_file_len) {
-			free(file);
-			goto error;
+	decoder->archive = archive;
+	decoder->data = data;
+	decoder->progress = 0;
+	decoder->total = data->length;
+	decoder->state = DECODER_HEADER;
+	return true;
+}
+
+/**
+ * Reads the container header, setting up the container codec
+ */
+static int archive_decode_header(archive_decoder_t* decoder)
+{
+	file_t* data = decoder->data;
+	if (data->length < 6) {
+		return DECODER_ERROR;
+	}
+
+	/* parse the archive in place */
+	codec_t* arc_codec = &decoder->codec;
+	codec_view(arc_codec, data->data, data->length);
+
+	decoder->final_len = codec_get24(arc_codec);
+	decoder->container_len = codec_get24(arc_codec);
+	decoder->whole = decoder->container_len != decoder->final_len;
+	decoder->progress = 6;
+
+	if (!decoder->whole) {
+		return DECODER_INDEX;
+	}
+
+	/* The entire container is compressed */
+	if (decoder->container_len > data->length-6 || decoder->inflater == NULL) {
+		return DECODER_ERROR;
+	}
+	arc_codec->allocator = decoder->archive->allocator;
+	codec_resize(arc_codec, decoder->final_len);
+	if (arc_codec->data == NULL) {
+		return DECODER_ERROR;
+	}
+	if (!bz2_inflate_begin((bz2_inflater_t*)decoder->inflater, decoder->archive->allocator, data->data+6, decoder->container_len, arc_codec->data, decoder->final_len)) {
+		return DECODER_ERROR;
+	}
+	return DECODER_CONTAINER;
+}
+
+/**
+ * Inflates a slice of a whole-compressed container
+ */
+static int archive_decode_container(archive_decoder_t* decoder)
+{
+	bz2_inflater_t* inflater = (bz2_inflater_t*)decoder->inflater;
+	int ret = bz2_inflate_step(inflater);
+	decoder->progress = 6 + inflater->stream.total_in_lo32 - sizeof(bz2_header);
+	if (ret == BZ_OK) {
+		return DECODER_CONTAINER;
+	}
+	if (ret != BZ_STREAM_END || inflater->stream.total_out_lo32 != decoder->final_len) {
+		return DECODER_ERROR;
+	}
+	bz2_inflate_end(inflater);
+	codec_seek(&decoder->codec, 0);
+	return DECODER_INDEX;
+}
+
+/**
+ * Reads the container index and sets aside space for the entries
+ */
+static int archive_decode_index(archive_decoder_t* decoder)
+{
+	codec_t* arc_codec = &decoder->codec;
+	decoder->num_files = codec_get16(arc_codec);
+	decoder->cur_file = 0;
+	decoder->file_ofs = arc_codec->caret + (decoder->num_files * 10);
+
+	/* size up the arena so every entry lands in one chunk */
+	size_t arena_len = decoder->num_files * ARENA_ROUND(sizeof(archive_file_t));
+	size_t index_caret = arc_codec->caret;
+	for (int i = 0; i < decoder->num_files; i++) {
+		codec_seek(arc_codec, arc_codec->caret + 4);
+		arena_len += ARENA_ROUND(codec_get24(arc_codec));
+		codec_seek(arc_codec, arc_codec->caret + 3);
+	}
+	codec_seek(arc_codec, index_caret);
+	arena_reserve(&decoder->archive->arena, arena_len);
+	return DECODER_FILE;
+}
+
+/**
+ * Adds the entry currently being decoded to the archive
+ */
+static int archive_decode_file_done(archive_decoder_t* decoder)
+{
+	archive_t* archive = decoder->archive;
+	list_push_back(&archive->files, &decoder->file->node);
+	archive->num_files++;
+	decoder->file_ofs += decoder->file_len;
+	decoder->cur_file++;
+	if (!decoder->whole) {
+		decoder->progress = decoder->file_ofs;
+	}
+	return DECODER_FILE;
+}
+
+/**
+ * Starts on the next entry, copying it straight out if it's uncompressed
+ */
+static int archive_decode_file(archive_decoder_t* decoder)
+{
+	if (decoder->cur_file == decoder->num_files) {
+		object_free(&decoder->codec);
+		codec_view(&decoder->codec, NULL, 0);
+		decoder->progress = decoder->total;
+		return DECODER_DONE;
+	}
+
+	/* gather file metadata */
+	codec_t* arc_codec = &decoder->codec;
+	archive_file_t* file = (archive_file_t*)arena_alloc(&decoder->archive->arena, sizeof(archive_file_t));
+	if (file == NULL) {
+		return DECODER_ERROR;
+	}
+	file->identifier = codec_get32(arc_codec);
+	uint32_t final_file_len = codec_get24(arc_codec);
+	uint32_t actual_file_len = codec_get24(arc_codec);
+	if (decoder->whole && final_file_len != actual_file_len) {
+		return DECODER_ERROR;
+	}
+	if (decoder->file_ofs + actual_file_len > arc_codec->length) {
+		return DECODER_ERROR;
+	}
+	file->file.length = final_file_len;
+	file->file.data = (unsigned char*)arena_alloc(&decoder->archive->arena, final_file_len);
+	file->file.allocator = NULL;
+	file->file.flags = FILE_BORROWED;
+	file->file.buffer = NULL;
+	if (file->file.data == NULL && final_file_len != 0) {
+		return DECODER_ERROR;
+	}
+	decoder->file = file;
+	decoder->file_len = actual_file_len;
+
+	/* locate file data */
+	if (decoder->whole) {
+		memcpy(file->file.data, arc_codec->data+decoder->file_ofs, final_file_len);
+		return archive_decode_file_done(decoder);
+	}
+	if (!bz2_inflate_begin((bz2_inflater_t*)decoder->inflater, decoder->archive->allocator, arc_codec->data+decoder->file_ofs, actual_file_len, file->file.data, final_file_len)) {
+		return DECODER_ERROR;
+	}
+	return DECODER_FILE_INFLATE;
+}
+
+/**
+ * Inflates a slice of a compressed entry
+ */
+static int archive_decode_file_inflate(archive_decoder_t* decoder)
+{
+	bz2_inflater_t* inflater = (bz2_inflater_t*)decoder->inflater;
+	int ret = bz2_inflate_step(inflater);
+	decoder->progress = decoder->file_ofs + inflater->stream.total_in_lo32 - sizeof(bz2_header);
+	if (ret == BZ_OK) {
+		return DECODER_FILE_INFLATE;
+	}
+	if (ret != BZ_STREAM_END) {
+		return DECODER_ERROR;
+	}
+	bz2_inflate_end(inflater);
+	return archive_decode_file_done(decoder);
+}
+
+/**
+ * Advances a decoder started with archive_decompress_begin
+ *  - budget_us: Roughly how long to spend before yielding, in microseconds. 0 runs to completion
+ * returns: ARCHIVE_DECODE_AGAIN if there's more to do, ARCHIVE_DECODE_DONE
+ *          once the archive is fully loaded, or ARCHIVE_DECODE_ERROR
+ */
+int archive_decompress_step(archive_decoder_t* decoder, uint32_t budget_us)
+{
+	uint64_t deadline = 0;
+	if (budget_us != 0) {
+		deadline = archive_clock_us() + budget_us;
+	}
+
+	while (true) {
+		switch (decoder->state) {
+		case DECODER_HEADER:
+			decoder->state = archive_decode_header(decoder);
+			break;
+		case DECODER_CONTAINER:
+			decoder->state = archive_decode_container(decoder);
+			break;
+		case DECODER_INDEX:
+			decoder->state = archive_decode_index(decoder);
+			break;
+		case DECODER_FILE:
+			decoder->state = archive_decode_file(decoder);
+			break;
+		case DECODER_FILE_INFLATE:
+			decoder->state = archive_decode_file_inflate(decoder);
+			break;
+		case DECODER_DONE:
+			return ARCHIVE_DECODE_DONE;
+		default:
+			bz2_inflate_end((bz2_inflater_t*)decoder->inflater);
+			decoder->state = DECODER_ERROR;
+			return ARCHIVE_DECODE_ERROR;
 		}
-		file->file.length = final_file_len;
-		file->file.data = (unsigned char*)malloc(final_file_len);
 
-		/* locate file data */
-		if (compressed) {
-			uint32_t decompressed_len = final_file_len;
-			bool success = bz2_headerless_decompress(arc_codec->data+file_ofs, actual_file_len, file->file.data, &decompressed_len);
-			if (!success) {
-				free(file->file.data);
-				free(file);
-				goto error;
-			}
-		} else {
-			memcpy(file->file.data, arc_codec->data+file_ofs, final_file_len);
+		if (deadline != 0 && archive_clock_us() >= deadline) {
+			break;
 		}
+	}
 
-		/* add it to our list */
-		list_push_back(&archive->files, &file->node);
-		archive->num_files++;
-		file_ofs += actual_file_len;
+	if (decoder->state == DECODER_DONE) {
+		return ARCHIVE_DECODE_DONE;
 	}
+	if (decoder->state == DECODER_ERROR) {
+		bz2_inflate_end((bz2_inflater_t*)decoder->inflater);
+		return ARCHIVE_DECODE_ERROR;
+	}
+	return ARCHIVE_DECODE_AGAIN;
+}
 
-	goto success;
-error:
-	object_free(arc_codec);
-	return false;
-success:
-	object_free(arc_codec);
-	return true;
+/**
+ * Decompresses an archive and loads the contents into memory
+ */
+bool archive_decompress(archive_t* archive, file_t* data)
+{
+	archive_decoder_t decoder;
+	object_init(archive_decoder, &decoder);
+	archive_decompress_begin(&decoder, archive, data);
+	int ret = archive_decompress_step(&decoder, 0);
+	object_free(&decoder);
+	return ret == ARCHIVE_DECODE_DONE;
 }
 
 /**
@@ -230,116 +504,322 @@ success:
  */
 bool archive_compress(archive_t* archive, file_t* out_file, uint8_t scheme)
 {
-	/* work out an absolute maximum buffer size */
-	size_t max_len = 0;
-	archive_file_t* file;
-	list_for_each(&archive->files) {
-		list_for_get(file);
-		max_len += file->file.length;
-	}
-
-	int index_block_length = (archive->num_files*10)+2;
-	int data_block_length = 0;
+	size_t index_block_length = (archive->num_files*10)+2;
 
+	/* the container is built in place after the 6 byte header */
 	codec_t* index_codec = object_new(codec);
-	codec_t* data_codec = object_new(codec);
+	codec_t* arc_codec = object_new(codec);
+	if (index_codec == NULL || arc_codec == NULL) {
+		goto error;
+	}
+	codec_set_allocator(index_codec, archive->allocator);
+	codec_set_allocator(arc_codec, archive->allocator);
 	codec_resize(index_codec, index_block_length);
-	codec_resize(data_codec, max_len);
+	codec_set_growable(arc_codec, true);
+	if (index_codec->data == NULL || !codec_reserve(arc_codec, 6+index_block_length)) {
+		goto error;
+	}
+	codec_seek(arc_codec, 6+index_block_length);
 
 	/* write the inner blocks */
 	codec_put16(index_codec, archive->num_files);
+	archive_file_t* file;
 	list_for_each(&archive->files) {
 		list_for_get(file);
 
 		/* compress the file if necessary */
 		uint32_t file_length = file->file.length;
-		unsigned char* file_data = (unsigned char*)malloc(file_length);
 		if (scheme == ARCHIVE_COMPRESS_FILE) {
-			bool success = bz2_headerless_compress(file->file.data, file->file.length, file_data, &file_length);
+			file_length = BZ2_COMPRESS_BOUND(file->file.length);
+			if (!codec_reserve(arc_codec, arc_codec->caret+file_length)) {
+				goto error;
+			}
+			bool success = bz2_headerless_compress(archive->allocator, file->file.data, file->file.length, arc_codec->data+arc_codec->caret, &file_length);
 			if (!success) {
-				free(file_data);
 				goto error;
 			}
+			codec_seek(arc_codec, arc_codec->caret+file_length);
 		} else {
-			memcpy(file_data, file->file.data, file_length);
+			codec_putn(arc_codec, file->file.data, file_length);
 		}
 
 		/* put the metadata */
 		codec_put32(index_codec, file->identifier);
 		codec_put24(index_codec, file->file.length);
 		codec_put24(index_codec, file_length);
-
-		/* put the file data */
-		codec_putn(data_codec, file_data, file_length);
-		data_block_length += file_length;
-		free(file_data);
 	}
 
-	/* concatenate the index and data blocks */
-	uint32_t final_arc_length = index_block_length+data_block_length;
+	/* fill in the index block */
+	uint32_t final_arc_length = codec_len(arc_codec)-6;
 	uint32_t actual_arc_length = final_arc_length;
-	unsigned char* contents_block = (unsigned char*)malloc(final_arc_length);
-
-	memcpy(contents_block, index_codec->data, index_block_length);
-	memcpy(contents_block+index_block_length, data_codec->data, data_block_length);
+	codec_seek(arc_codec, 6);
+	codec_putn(arc_codec, index_codec->data, index_block_length);
 
 	/* compress the container if necessary */
 	if (scheme == ARCHIVE_COMPRESS_WHOLE) {
-		unsigned char* tmp_buf = (unsigned char*)malloc(final_arc_length);
-		bool success = bz2_headerless_compress(contents_block, final_arc_length, tmp_buf, &actual_arc_length);
+		codec_t* whole_codec = object_new(codec);
+		if (whole_codec == NULL) {
+			goto error;
+		}
+		codec_set_allocator(whole_codec, archive->allocator);
+		actual_arc_length = BZ2_COMPRESS_BOUND(final_arc_length);
+		bool success = codec_reserve(whole_codec, 6+actual_arc_length);
+		if (success) {
+			success = bz2_headerless_compress(archive->allocator, arc_codec->data+6, final_arc_length, whole_codec->data+6, &actual_arc_length);
+		}
+		object_free(arc_codec);
+		arc_codec = whole_codec;
 		if (!success) {
-			free(tmp_buf);
-			free(contents_block);
 			goto error;
 		}
-		memcpy(contents_block, tmp_buf, actual_arc_length);
-		free(tmp_buf);
 	}
-	
-	object_free(index_codec);
-	object_free(data_codec);
 
-	/* write the container and the final archive */
-	codec_t* arc_codec = object_new(codec);
-	codec_resize(arc_codec, actual_arc_length+6);
+	/* write the container header */
+	codec_seek(arc_codec, 0);
 	codec_put24(arc_codec, final_arc_length);
 	codec_put24(arc_codec, actual_arc_length);
-	codec_putn(arc_codec, contents_block, actual_arc_length);
+	codec_seek(arc_codec, actual_arc_length+6);
+	codec_shrink(arc_codec);
+	if (arc_codec->length != codec_len(arc_codec)) {
+		/* out_file can't describe a buffer larger than its length */
+		goto error;
+	}
 
-	/* copy it all to out_file and clean up for exit */
-	out_file->data = (unsigned char*)malloc(actual_arc_length+6);
-	out_file->length = actual_arc_length+6;
-	memcpy(out_file->data, arc_codec->data, actual_arc_length+6);
-	object_free(arc_codec);
+	/* hand the buffer over to out_file */
+	out_file->length = codec_len(arc_codec);
+	out_file->data = arc_codec->data;
+	out_file->allocator = arc_codec->allocator;
+	out_file->flags = 0;
+	arc_codec->data = NULL;
 
 	goto success;
 error:
-	object_free(index_codec);
-	object_free(data_codec);
+	if (index_codec != NULL) {
+		object_free(index_codec);
+	}
+	if (arc_codec != NULL) {
+		object_free(arc_codec);
+	}
 	return false;
 success:
+	object_free(index_codec);
+	object_free(arc_codec);
 	return true;
 }
 
 /**
- * Adds a file_t to the archive with a given identifier
- * returns: The corresponding archive_file_t
+ * A single decompress or compress job within a batch
  */
-archive_file_t* archive_add_file(archive_t* archive, jhash_t identifier, file_t* file)
+typedef struct archive_job archive_job_t;
+struct archive_job {
+	archive_t* archive;
+	file_t* file;
+	uint8_t scheme;
+	bool compress;
+	size_t size;
+	bool success;
+};
+
+/**
+ * Runs an archive_job_t
+ */
+static void archive_job_run(archive_job_t* job)
+{
+	if (job->compress) {
+		job->success = archive_compress(job->archive, job->file, job->scheme);
+	} else {
+		job->success = archive_decompress(job->archive, job->file);
+	}
+}
+
+/**
+ * Orders archive_job_t pointers largest first
+ */
+static int archive_job_compare(const void* a, const void* b)
+{
+	const archive_job_t* job_a = *(const archive_job_t**)a;
+	const archive_job_t* job_b = *(const archive_job_t**)b;
+	if (job_a->size == job_b->size) {
+		return 0;
+	}
+	return job_a->size > job_b->size ? -1 : 1;
+}
+
+/**
+ * Runs a batch of jobs on a pool, largest first so that the big jobs
+ * don't end up as the tail of the batch.
+ *  - results: Per-job results in input order, or NULL
+ * returns: Whether every job succeeded
+ */
+static bool archive_run_batch(thread_pool_t* pool, archive_job_t* jobs, size_t count, bool* results)
+{
+	if (pool == NULL) {
+		for (size_t i = 0; i < count; i++) {
+			archive_job_run(&jobs[i]);
+		}
+	} else {
+		runite_allocator_t* allocator = runite_allocator_get();
+		archive_job_t** order = (archive_job_t**)runite_alloc(allocator, sizeof(archive_job_t*)*count);
+		if (order != NULL) {
+			for (size_t i = 0; i < count; i++) {
+				order[i] = &jobs[i];
+			}
+			qsort(order, count, sizeof(archive_job_t*), archive_job_compare);
+		}
+
+		task_group_t group;
+		object_init(task_group, &group);
+		for (size_t i = 0; i < count; i++) {
+			/* without the order, just run the jobs as they come */
+			archive_job_t* job = order != NULL ? order[i] : &jobs[i];
+			thread_pool_submit(pool, &group, (task_func_t)archive_job_run, job);
+		}
+		task_group_wait(pool, &group);
+		object_free(&group);
+		runite_free(allocator, order, sizeof(archive_job_t*)*count);
+	}
+
+	bool success = true;
+	for (size_t i = 0; i < count; i++) {
+		if (results != NULL) {
+			results[i] = jobs[i].success;
+		}
+		success = success && jobs[i].success;
+	}
+	return success;
+}
+
+/**
+ * Decompresses many archives concurrently
+ *  - pool: The pool to run on, or NULL to decompress on the calling thread
+ *  - archives: Where to load each of the inputs
+ *  - inputs: The archive data
+ *  - results: Filled with each archive's result in input order, or NULL
+ * returns: Whether every archive was decompressed
+ */
+bool archive_decompress_batch(thread_pool_t* pool, archive_t** archives, file_t* inputs, size_t count, bool* results)
+{
+	runite_allocator_t* allocator = runite_allocator_get();
+	archive_job_t* jobs = (archive_job_t*)runite_alloc(allocator, sizeof(archive_job_t)*count);
+	if (jobs == NULL && count > 0) {
+		if (results != NULL) {
+			memset(results, 0, sizeof(bool)*count);
+		}
+		return false;
+	}
+	for (size_t i = 0; i < count; i++) {
+		jobs[i].archive = archives[i];
+		jobs[i].file = &inputs[i];
+		jobs[i].compress = false;
+		jobs[i].size = inputs[i].length;
+		jobs[i].success = false;
+	}
+	bool success = archive_run_batch(pool, jobs, count, results);
+	runite_free(allocator, jobs, sizeof(archive_job_t)*count);
+	return success;
+}
+
+/**
+ * Compresses many archives concurrently
+ *  - pool: The pool to run on, or NULL to compress on the calling thread
+ *  - schemes: The scheme to compress each archive with
+ *  - outputs: Where to store each compressed archive
+ *  - results: Filled with each archive's result in input order, or NULL
+ * returns: Whether every archive was compressed
+ */
+bool archive_compress_batch(thread_pool_t* pool, archive_t** archives, uint8_t* schemes, file_t* outputs, size_t count, bool* results)
+{
+	runite_allocator_t* allocator = runite_allocator_get();
+	archive_job_t* jobs = (archive_job_t*)runite_alloc(allocator, sizeof(archive_job_t)*count);
+	if (jobs == NULL && count > 0) {
+		if (results != NULL) {
+			memset(results, 0, sizeof(bool)*count);
+		}
+		return false;
+	}
+	for (size_t i = 0; i < count; i++) {
+		jobs[i].archive = archives[i];
+		jobs[i].file = &outputs[i];
+		jobs[i].scheme = schemes[i];
+		jobs[i].compress = true;
+		jobs[i].size = 0;
+		jobs[i].success = false;
+
+		archive_file_t* file;
+		list_for_each(&archives[i]->files) {
+			list_for_get(file);
+			jobs[i].size += file->file.length;
+		}
+	}
+	bool success = archive_run_batch(pool, jobs, count, results);
+	runite_free(allocator, jobs, sizeof(archive_job_t)*count);
+	return success;
+}
+
+/**
+ * Allocates an entry for a new file, which the caller fills in and adds
+ * returns: The entry, or NULL on collision or allocation failure
+ */
+static archive_file_t* archive_new_file(archive_t* archive, jhash_t identifier)
 {
 	/* check for collision */
 	if (archive_get_file(archive, identifier) != NULL) {
 		return NULL;
 	}
-
-	/* create the structures */
-	archive_file_t* archive_file = (archive_file_t*)malloc(sizeof(archive_file_t));
+	archive_file_t* archive_file = (archive_file_t*)arena_alloc(&archive->arena, sizeof(archive_file_t));
+	if (archive_file == NULL) {
+		return NULL;
+	}
 	archive_file->identifier = identifier;
+	return archive_file;
+}
+
+/**
+ * Adds a copy of a file_t to the archive with a given identifier. Only
+ * the file's length and data are read.
+ * returns: The corresponding archive_file_t, or NULL on collision or
+ *          allocation failure
+ */
+archive_file_t* archive_add_file(archive_t* archive, jhash_t identifier, file_t* file)
+{
+	archive_file_t* archive_file = archive_new_file(archive, identifier);
+	if (archive_file == NULL) {
+		return NULL;
+	}
 	archive_file->file.length = file->length;
-	archive_file->file.data = (unsigned char*)malloc(file->length);
+	archive_file->file.data = (unsigned char*)arena_alloc(&archive->arena, file->length);
+	archive_file->file.allocator = NULL;
+	archive_file->file.flags = FILE_BORROWED;
+	archive_file->file.buffer = NULL;
+	if (archive_file->file.data == NULL) {
+		arena_release(&archive->arena, archive_file, sizeof(archive_file_t));
+		return NULL;
+	}
 	memcpy(archive_file->file.data, file->data, file->length);
-	
-	/* add it */
+
+	list_push_back(&archive->files, &archive_file->node);
+	archive->num_files++;
+	return archive_file;
+}
+
+/**
+ * Adds a reference to a file_t's contents to the archive with a given
+ * identifier, rather than a copy. The file is shared first if need be,
+ * see file_ref.
+ * returns: The corresponding archive_file_t, or NULL on collision,
+ *          allocation failure, or if the file's contents can't be shared
+ */
+archive_file_t* archive_ref_file(archive_t* archive, jhash_t identifier, file_t* file)
+{
+	archive_file_t* archive_file = archive_new_file(archive, identifier);
+	if (archive_file == NULL) {
+		return NULL;
+	}
+	if (!file_ref(&archive_file->file, file)) {
+		arena_release(&archive->arena, archive_file, sizeof(archive_file_t));
+		return NULL;
+	}
+
 	list_push_back(&archive->files, &archive_file->node);
 	archive->num_files++;
 	return archive_file;
@@ -347,6 +827,9 @@ archive_file_t* archive_add_file(archive_t* archive, jhash_t identifier, file_t*
 
 /**
  * Removes an archive_file_t from the archive
+ * The entry and its contents go back to the archive's arena to be reused
+ * by later entries, and a shared entry drops its reference. file is no
+ * longer valid afterwards.
  */
 void archive_remove_file(archive_t* archive, archive_file_t* file)
 {
@@ -358,8 +841,61 @@ void archive_remove_file(archive_t* archive, archive_file_t* file)
 	/* remove it */
 	list_erase(&archive->files, &file->node);
 	archive->num_files--;
-	free(file->file.data);
-	free(file);
+	if (file->file.flags & FILE_SHARED) {
+		file_free(&file->file);
+	} else if (file->file.flags & FILE_BORROWED) {
+		arena_release(&archive->arena, file->file.data, file->file.length);
+	}
+	arena_release(&archive->arena, file, sizeof(archive_file_t));
+}
+
+/**
+ * Removes an archive_file_t from the archive, moving its contents onto
+ * the archive's allocator so they outlive the archive. A shared entry
+ * hands its reference to out_file instead. Caller is responsible for
+ * freeing out_file with file_free.
+ *  - out_file: Where to store the detached file
+ */
+bool archive_detach_file(archive_t* archive, archive_file_t* file, file_t* out_file)
+{
+	if (archive_get_file(archive, file->identifier) == NULL) {
+		return false;
+	}
+
+	/* a shared entry just hands its reference over */
+	if (file->file.flags & FILE_SHARED) {
+		*out_file = file->file;
+		file->file.flags = 0;
+		file->file.buffer = NULL;
+		archive_remove_file(archive, file);
+		return true;
+	}
+
+	out_file->data = (unsigned char*)runite_alloc(archive->allocator, file->file.length);
+	if (out_file->data == NULL && file->file.length != 0) {
+		return false;
+	}
+	out_file->allocator = archive->allocator;
+	out_file->flags = 0;
+	out_file->length = file->file.length;
+	memcpy(out_file->data, file->file.data, file->file.length);
+
+	archive_remove_file(archive, file);
+	return true;
+}
+
+/**
+ * Sets the allocator for an archive's entries, its output buffers and
+ * bzlib. Only possible while the archive hasn't allocated anything yet.
+ */
+bool archive_set_allocator(archive_t* archive, runite_allocator_t* allocator)
+{
+	if (archive->arena.head != NULL) {
+		return false;
+	}
+	archive->allocator = allocator;
+	archive->arena.allocator = allocator;
+	return true;
 }
 
 /**
@@ -377,7 +913,15 @@ archive_file_t* archive_get_file(archive_t* archive, jhash_t identifier)
 	return NULL;
 }
 
+static object_slab_t archive_slab = OBJECT_SLAB_INITIALIZER;
+
 object_proto_t archive_proto = {
 	.init = (object_init_t)archive_init,
-	.free = (object_free_t)archive_free
+	.free = (object_free_t)archive_free,
+	.slab = &archive_slab
+};
+
+object_proto_t archive_decoder_proto = {
+	.init = (object_init_t)archive_decoder_init,
+	.free = (object_free_t)archive_decoder_free
 };
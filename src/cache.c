@@ -21,21 +21,71 @@
 #include <stdlib.h>
 #include <string.h>
 #include <dirent.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <netinet/in.h>
+#include <pthread.h>
 #include <zlib.h>
 
-#include <runite/util/sorted_list.h>
+#include <runite/util/rbtree.h>
 #include <runite/util/container_of.h>
 #include <runite/util/codec.h>
+#include <runite/util/codec_cursor.h>
 
 #define DATA_BLOCK_SIZE 520
 #define INDEX_ENTRY_SIZE 6
+#define MAX_INDEX_FILES (1 << 24)
 
-static void cache_fs_get(codec_t* data_indices, codec_t* data_blocks, int index_id, int file_id, file_t* cache_file);
+#define HUGEPAGE_SIZE (2*1024*1024)
+#define STREAM_CHUNK_BLOCKS 128
+
+typedef struct cache_index cache_index_t;
+
+/**
+ * Read access to the data file, one block at a time. The file is mapped
+ * where possible; otherwise it is read with pread through a bounded chunk
+ * buffer, so memory use doesn't grow with the size of the file. Reads
+ * through the chunk buffer are serialized by lock once the cache is open.
+ */
+struct cache_dat {
+	pthread_mutex_t lock;
+	int fd;
+	uint64_t size;
+	uint64_t num_blocks;
+	unsigned char* map;
+	unsigned char* chunk;
+	uint64_t chunk_start;
+	uint64_t chunk_blocks;
+	int error;
+};
+
+/**
+ * Owns an index's files, and the array of them, so that they outlive the
+ * cache for as long as a reference is held to one of them. The files
+ * borrow from buffer, and the last reference to it frees them. With
+ * CACHE_LOAD_CONTIGUOUS their contents lie in one slab, which is buffer's
+ * data; otherwise each file has an allocation of its own.
+ */
+struct cache_index {
+	file_buffer_t buffer;
+	runite_allocator_t* allocator;
+	file_t* files;
+	int num_files;
+};
+
+static bool cache_fs_entry(codec_t* data_indices, int file_id, size_t* length, uint32_t* first_block);
+static bool cache_fs_read(cache_dat_t* dat, int index_id, int file_id, uint32_t first_block, unsigned char* dest, size_t length);
+static void cache_fs_get(cache_index_t* owner, cache_dat_t* dat, int index_id, int file_id, cache_meta_t* meta);
+static void cache_fs_get_index(cache_t* cache, cache_index_t* owner, cache_dat_t* dat, int index_id);
+static bool cache_meta_load(cache_t* cache, cache_meta_t* meta, codec_t* data_indices, int num_files);
 
 typedef struct index_list_node index_list_node_t;
 struct index_list_node {
-	list_node_t node;
+	rbtree_node_t node;
 	char index[256];
 };
 
@@ -44,36 +94,115 @@ struct index_list_node {
  */
 static void cache_init(cache_t* cache)
 {
+	cache->allocator = runite_allocator_get();
+	cache->load_flags = 0;
 	cache->num_files = 0;
 	cache->files = 0;
+	cache->indices = NULL;
+	cache->meta = NULL;
+	cache->dat = NULL;
+}
+
+/**
+ * Returns how many entries an index's metadata arrays are allocated with
+ */
+static size_t cache_meta_count(int num_files)
+{
+	return num_files > 0 ? num_files : 1;
+}
+
+/**
+ * Frees an index's files with the last reference to its buffer
+ */
+static void cache_index_release(file_buffer_t* buffer)
+{
+	cache_index_t* owner = container_of(buffer, cache_index_t, buffer);
+	runite_allocator_t* allocator = owner->allocator;
+	if (buffer->flags & FILE_MAPPED) {
+		munmap(buffer->data, buffer->length);
+	} else if (buffer->data != NULL) {
+		runite_free(allocator, buffer->data, buffer->length);
+	} else {
+		for (int x = 0; x < owner->num_files; x++) {
+			runite_free(allocator, owner->files[x].data, owner->files[x].length);
+		}
+	}
+	runite_free(allocator, owner->files, sizeof(file_t)*cache_meta_count(owner->num_files));
+	runite_free(allocator, owner, sizeof(cache_index_t));
+}
+
+/**
+ * Allocates the owner of an index's files, with every file empty and
+ * borrowing from it
+ * returns: The owner, holding the cache's reference, or NULL
+ */
+static cache_index_t* cache_index_new(cache_t* cache, int num_files)
+{
+	cache_index_t* owner = (cache_index_t*)runite_alloc(cache->allocator, sizeof(cache_index_t));
+	if (owner == NULL) {
+		return NULL;
+	}
+	owner->files = (file_t*)runite_alloc(cache->allocator, sizeof(file_t)*cache_meta_count(num_files));
+	if (owner->files == NULL) {
+		runite_free(cache->allocator, owner, sizeof(cache_index_t));
+		return NULL;
+	}
+	file_buffer_init(&owner->buffer, NULL, 0, cache_index_release);
+	owner->allocator = cache->allocator;
+	owner->num_files = num_files;
+	for (int x = 0; x < num_files; x++) {
+		owner->files[x].length = 0;
+		owner->files[x].data = NULL;
+		owner->files[x].flags = FILE_BORROWED;
+		owner->files[x].buffer = &owner->buffer;
+	}
+	return owner;
 }
 
+static void cache_dat_close(cache_dat_t* dat);
+
 /**
  * Cleans up a cache_t
+ * Files that have been shared with file_ref or file_slice outlive it.
  */
 static void cache_free(cache_t* cache)
 {
-	if (cache->num_files != 0) {
-		free(cache->num_files);
+	if (cache->dat != NULL) {
+		cache_dat_close(cache->dat);
+		free(cache->dat);
 	}
-	if (cache->files != 0) {
+	if (cache->indices != NULL) {
+		/* each index's files borrow from its buffer, and go with it */
 		for (int i = 0; i < cache->num_indices; i++) {
-			for (int x = 0; x < cache->num_files[i]; x++) {
-				file_t* file = &cache->files[i][x];
-				if (file->data != NULL) {
-					free(file->data);
-				}
+			if (cache->indices[i] != NULL) {
+				file_buffer_release(cache->indices[i]);
 			}
-			free(cache->files[i]);
 		}
+		free(cache->indices);
+	}
+	if (cache->files != 0) {
 		free(cache->files);
 	}
+	if (cache->meta != NULL) {
+		for (int i = 0; i < cache->num_indices; i++) {
+			cache_meta_t* meta = &cache->meta[i];
+			size_t count = cache_meta_count(cache->num_files != 0 ? cache->num_files[i] : 0);
+			runite_free(cache->allocator, meta->lengths, sizeof(uint32_t)*count);
+			runite_free(cache->allocator, meta->sectors, sizeof(uint32_t)*count);
+			runite_free(cache->allocator, meta->crcs, sizeof(uint32_t)*count);
+			runite_free(cache->allocator, meta->versions, sizeof(uint16_t)*count);
+		}
+		free(cache->meta);
+	}
+	if (cache->num_files != 0) {
+		free(cache->num_files);
+	}
 }
 
 /**
- * A wrapper around strcmp that operates on 'list_node_t's
+ * A wrapper around strcmp that operates on 'rbtree_node_t's
  */
-static int strcmp_wrap(list_node_t* a, list_node_t* b) {
+static int strcmp_wrap(rbtree_node_t* a, rbtree_node_t* b) {
 	index_list_node_t* nodeA = container_of(a, index_list_node_t, node);
 	index_list_node_t* nodeB = container_of(b, index_list_node_t, node);
 	return strcmp((const char*)nodeA->index, (const char*)nodeB->index);
@@ -81,6 +210,7 @@ static int strcmp_wrap(list_node_t* a, list_node_t* b) {
 
 /**
  * Opens a directory in cache fs form (ie. client cached index + data files)
+ * returns: CACHE_OK, or a CACHE_ERROR_ code
  */
 int cache_open_fs_dir(cache_t* cache, const char* directory)
 {
@@ -88,101 +218,349 @@ int cache_open_fs_dir(cache_t* cache, const char* directory)
 	struct dirent *entry;
 	int num_indices = 0;
 
-	sorted_list_t* index_list = object_new(sorted_list);
-	index_list->compare_func = strcmp_wrap;
 	if (dir == NULL) {
-		return 1;
+		return CACHE_ERROR_OPEN;
+	}
+	rbtree_t* index_list = object_new(rbtree);
+	if (index_list == NULL) {
+		closedir(dir);
+		return CACHE_ERROR_MEMORY;
 	}
+	index_list->compare_func = strcmp_wrap;
 
-	char data_file[256];
+	char data_file[PATH_MAX];
+	data_file[0] = '\0';
+	bool truncated = false;
 	while ((entry = readdir(dir)) != NULL) {
 		if (strstr(entry->d_name, "idx")) {
 			index_list_node_t* node = (index_list_node_t*)malloc(sizeof(index_list_node_t));
-			strcpy(node->index, entry->d_name);
-			sorted_list_insert(index_list, &node->node);
+			snprintf(node->index, sizeof(node->index), "%s", entry->d_name);
+			rbtree_insert(index_list, &node->node);
 			num_indices++;
 		} else if (strstr(entry->d_name, "dat")) {
-			sprintf(data_file, "%s/%s", directory, entry->d_name);
+			if (snprintf(data_file, sizeof(data_file), "%s/%s", directory, entry->d_name) >= (int)sizeof(data_file)) {
+				truncated = true;
+			}
 		}
 	}
+	closedir(dir);
 
-	if (data_file == NULL || num_indices == 0) {
-		return 1;
-	}
-
-	char** index_files = (char**)malloc(sizeof(char*)*num_indices);
+	char** index_files = (char**)malloc(sizeof(char*)*(num_indices > 0 ? num_indices : 1));
 	int i = 0;
-	while (!list_empty(&index_list->list)) {
-		list_node_t* node = list_front(&index_list->list);
+	while (!rbtree_empty(index_list)) {
+		rbtree_node_t* node = rbtree_first(index_list);
 		index_list_node_t* index_node = container_of(node, index_list_node_t, node);
-		index_files[i] = (char*)malloc(sizeof(char)*256);
-		sprintf(index_files[i++], "%s/%s", directory, (char*)index_node->index);
-		list_erase(&index_list->list, node);
+		index_files[i] = (char*)malloc(sizeof(char)*PATH_MAX);
+		if (snprintf(index_files[i++], PATH_MAX, "%s/%s", directory, (char*)index_node->index) >= PATH_MAX) {
+			truncated = true;
+		}
+		rbtree_erase(index_list, node);
 		free(index_node);
 	}
 	object_free(index_list);
-	closedir(dir);
 
-	cache_open_fs(cache, num_indices, (const char**)index_files, data_file);
+	int result = CACHE_ERROR_OPEN;
+	if (data_file[0] != '\0' && num_indices > 0 && !truncated) {
+		result = cache_open_fs(cache, num_indices, (const char**)index_files, data_file);
+	}
 
 	for (int i = 0; i < num_indices; i++) {
 		free(index_files[i]);
 	}
 	free(index_files);
 
-	return 0;
+	return result;
 }
 
 /**
- * Opens a cache fs from memory (ie. client cached index + data files)
+ * Sets the allocator for the cache's file contents and load buffers
+ * Only possible before the cache is opened.
  */
-void cache_open_fs(cache_t* cache, int num_indices, const char** index_files, const char* data_file)
+bool cache_set_allocator(cache_t* cache, runite_allocator_t* allocator)
 {
-	cache->num_indices = num_indices;
+	if (cache->meta != NULL) {
+		return false;
+	}
+	cache->allocator = allocator;
+	return true;
+}
 
-	codec_t* data_indices;
-	codec_t data_blocks;
-	int num_blocks;
+/**
+ * Sets how the cache lays out file contents when it is opened
+ * Only possible before the cache is opened.
+ *  - flags: CACHE_LOAD_CONTIGUOUS to put every file of an index into one
+ *           buffer instead of one allocation per file, plus
+ *           CACHE_LOAD_HUGEPAGES to back those buffers with huge pages
+ *           where the system allows it. CACHE_LOAD_METADATA loads only
+ *           the idx metadata, and files are read from the data file
+ *           when asked for with cache_read_file.
+ */
+bool cache_set_load_flags(cache_t* cache, int flags)
+{
+	if (cache->meta != NULL) {
+		return false;
+	}
+	cache->load_flags = flags;
+	return true;
+}
+
+/**
+ * Opens the data file for block reads
+ *  - stream: Read through the chunk buffer even if the file could be mapped
+ * returns: CACHE_OK, or a CACHE_ERROR_ code
+ */
+static int cache_dat_open(cache_dat_t* dat, const char* path, bool stream)
+{
+	memset(dat, 0, sizeof(cache_dat_t));
+	dat->fd = open(path, O_RDONLY);
+	if (dat->fd < 0) {
+		return CACHE_ERROR_OPEN;
+	}
+	struct stat info;
+	if (fstat(dat->fd, &info) != 0) {
+		close(dat->fd);
+		return CACHE_ERROR_READ;
+	}
+	dat->size = (uint64_t)info.st_size;
+	/* the last block is usually only written as far as it's used */
+	dat->num_blocks = (dat->size + DATA_BLOCK_SIZE - 1) / DATA_BLOCK_SIZE;
+	dat->error = CACHE_OK;
+
+	if (!stream && dat->size > 0 && dat->size <= SIZE_MAX) {
+		void* map = mmap(NULL, (size_t)dat->size, PROT_READ, MAP_PRIVATE, dat->fd, 0);
+		if (map != MAP_FAILED) {
+			dat->map = (unsigned char*)map;
+		}
+	}
+	if (dat->map == NULL) {
+		dat->chunk = (unsigned char*)malloc(STREAM_CHUNK_BLOCKS*DATA_BLOCK_SIZE);
+		if (dat->chunk == NULL) {
+			close(dat->fd);
+			return CACHE_ERROR_MEMORY;
+		}
+	}
+	pthread_mutex_init(&dat->lock, NULL);
+	return CACHE_OK;
+}
+
+/**
+ * Closes the data file
+ */
+static void cache_dat_close(cache_dat_t* dat)
+{
+	if (dat->map != NULL) {
+		munmap(dat->map, (size_t)dat->size);
+	}
+	free(dat->chunk);
+	close(dat->fd);
+	pthread_mutex_destroy(&dat->lock);
+}
+
+/**
+ * Fetches one block of the data file
+ *  - length: Set to the number of bytes available, which may be short of
+ *            DATA_BLOCK_SIZE for the last block
+ * returns: The block, or NULL if it is past the end of the file or could
+ *          not be read. Read errors are also recorded in dat->error.
+ */
+static const unsigned char* cache_dat_block(cache_dat_t* dat, uint64_t block, size_t* length)
+{
+	if (block >= dat->num_blocks) {
+		return NULL;
+	}
+	uint64_t offset = block*DATA_BLOCK_SIZE;
+	uint64_t available = dat->size - offset;
+	*length = available < DATA_BLOCK_SIZE ? (size_t)available : DATA_BLOCK_SIZE;
+	if (dat->map != NULL) {
+		return dat->map + offset;
+	}
 
-	/* Read the data file into memory */
-	FILE *data_fd = fopen(data_file, "r");
-	fseek(data_fd, 0, SEEK_END);
-	int data_size = ftell(data_fd);
+	if (block < dat->chunk_start || block >= dat->chunk_start + dat->chunk_blocks) {
+		uint64_t chunk_bytes = dat->size - offset;
+		if (chunk_bytes > STREAM_CHUNK_BLOCKS*DATA_BLOCK_SIZE) {
+			chunk_bytes = STREAM_CHUNK_BLOCKS*DATA_BLOCK_SIZE;
+		}
+		size_t done = 0;
+		while (done < chunk_bytes) {
+			ssize_t n = pread(dat->fd, dat->chunk+done, chunk_bytes-done, (off_t)(offset+done));
+			if (n < 0 && errno == EINTR) {
+				continue;
+			}
+			if (n <= 0) {
+				dat->chunk_blocks = 0;
+				dat->error = CACHE_ERROR_READ;
+				return NULL;
+			}
+			done += n;
+		}
+		dat->chunk_start = block;
+		dat->chunk_blocks = (chunk_bytes + DATA_BLOCK_SIZE - 1) / DATA_BLOCK_SIZE;
+	}
+	return dat->chunk + (block - dat->chunk_start)*DATA_BLOCK_SIZE;
+}
 
-	object_init(codec, &data_blocks);
-	codec_resize(&data_blocks, data_size);
-	num_blocks = data_size / DATA_BLOCK_SIZE;
+/**
+ * Reads a whole index file into memory
+ * returns: CACHE_OK, or a CACHE_ERROR_ code
+ */
+static int cache_read_index(runite_allocator_t* allocator, const char* path, unsigned char** buf, int* num_files)
+{
+	FILE* index_fd = fopen(path, "r");
+	if (index_fd == NULL) {
+		return CACHE_ERROR_OPEN;
+	}
 
-	fseek(data_fd, 0, SEEK_SET);
-	fread(data_blocks.data, DATA_BLOCK_SIZE, num_blocks, data_fd);
-	fclose(data_fd);
+	int result = CACHE_OK;
+	struct stat info;
+	if (fstat(fileno(index_fd), &info) != 0) {
+		result = CACHE_ERROR_READ;
+		goto exit;
+	}
+	uint64_t count = (uint64_t)info.st_size / INDEX_ENTRY_SIZE;
+	if (count > MAX_INDEX_FILES) {
+		result = CACHE_ERROR_FORMAT;
+		goto exit;
+	}
+
+	*num_files = (int)count;
+	*buf = (unsigned char*)runite_alloc(allocator, count*INDEX_ENTRY_SIZE);
+	if (*buf == NULL && count > 0) {
+		result = CACHE_ERROR_MEMORY;
+		goto exit;
+	}
+	if (fread(*buf, INDEX_ENTRY_SIZE, count, index_fd) != count) {
+		runite_free(allocator, *buf, count*INDEX_ENTRY_SIZE);
+		*buf = NULL;
+		result = CACHE_ERROR_READ;
+	}
+exit:
+	fclose(index_fd);
+	return result;
+}
+
+/**
+ * Opens a cache fs from memory (ie. client cached index + data files)
+ * The data file is mapped, or streamed in chunks with CACHE_LOAD_STREAM,
+ * rather than read into memory whole. With CACHE_LOAD_METADATA it is
+ * kept open instead, for cache_read_file.
+ * returns: CACHE_OK, or a CACHE_ERROR_ code. The cache is left safe to
+ *          free on error.
+ */
+int cache_open_fs(cache_t* cache, int num_indices, const char** index_files, const char* data_file)
+{
+	cache_dat_t load_dat;
+	cache_dat_t* dat = &load_dat;
+	bool metadata_only = cache->load_flags & CACHE_LOAD_METADATA;
+	int result = CACHE_OK;
+
+	if (cache->meta != NULL) {
+		return CACHE_ERROR_FORMAT;
+	}
+	if (metadata_only) {
+		dat = (cache_dat_t*)malloc(sizeof(cache_dat_t));
+		if (dat == NULL) {
+			return CACHE_ERROR_MEMORY;
+		}
+	}
+	result = cache_dat_open(dat, data_file, cache->load_flags & CACHE_LOAD_STREAM);
+	if (result != CACHE_OK) {
+		if (metadata_only) {
+			free(dat);
+		}
+		return result;
+	}
+	if (metadata_only) {
+		cache->dat = dat;
+	} else if (dat->map != NULL) {
+		/* every block is about to be read */
+		madvise(dat->map, (size_t)dat->size, MADV_WILLNEED);
+	}
 
-	/* Read the indices into memory */
+	cache->num_indices = num_indices;
 	cache->num_files = (int*)calloc(sizeof(int), num_indices);
-	cache->files = (file_t**)malloc(sizeof(file_t*)*num_indices);
-	data_indices = (codec_t*)malloc(sizeof(codec_t)*num_indices);
-	for (int i = 0; i < num_indices; i++) {
-		FILE* index_fd = fopen(index_files[i], "r");
-		fseek(index_fd, 0, SEEK_END);
-		int index_size = ftell(index_fd);
+	cache->meta = (cache_meta_t*)calloc(sizeof(cache_meta_t), num_indices);
+	if (cache->num_files == NULL || cache->meta == NULL) {
+		result = CACHE_ERROR_MEMORY;
+		goto exit;
+	}
+	if (!metadata_only) {
+		cache->files = (file_t**)calloc(sizeof(file_t*), num_indices);
+		cache->indices = (file_buffer_t**)calloc(sizeof(file_buffer_t*), num_indices);
+		if (cache->files == NULL || cache->indices == NULL) {
+			result = CACHE_ERROR_MEMORY;
+			goto exit;
+		}
+	}
 
-		object_init(codec, &data_indices[i]);
-		codec_resize(&data_indices[i], index_size);
-		cache->num_files[i] = index_size / INDEX_ENTRY_SIZE;
-		cache->files[i] = (file_t*)malloc(sizeof(file_t)*cache->num_files[i]);
+	for (int i = 0; i < num_indices; i++) {
+		unsigned char* index_buf = NULL;
+		int num_files = 0;
+		result = cache_read_index(cache->allocator, index_files[i], &index_buf, &num_files);
+		if (result != CACHE_OK) {
+			goto exit;
+		}
 
-		fseek(index_fd, 0, SEEK_SET);
-		fread(data_indices[i].data, INDEX_ENTRY_SIZE, cache->num_files[i], index_fd);
-		fclose(index_fd);
+		codec_t data_indices;
+		codec_view(&data_indices, index_buf, (size_t)num_files*INDEX_ENTRY_SIZE);
+		bool loaded = cache_meta_load(cache, &cache->meta[i], &data_indices, num_files);
+		object_free(&data_indices);
+		runite_free(cache->allocator, index_buf, (size_t)num_files*INDEX_ENTRY_SIZE);
+		if (!loaded) {
+			result = CACHE_ERROR_MEMORY;
+			goto exit;
+		}
+		cache->num_files[i] = num_files;
 
-		for (int x = 0; x < cache->num_files[i]; x++) {
-			cache_fs_get(&data_indices[i], &data_blocks, i, x, &cache->files[i][x]);
+		if (metadata_only) {
+			continue;
 		}
+		cache_index_t* owner = cache_index_new(cache, num_files);
+		if (owner == NULL) {
+			result = CACHE_ERROR_MEMORY;
+			goto exit;
+		}
+		cache->indices[i] = &owner->buffer;
+		cache->files[i] = owner->files;
+		if (cache->load_flags & CACHE_LOAD_CONTIGUOUS) {
+			cache_fs_get_index(cache, owner, dat, i);
+		} else {
+			for (int x = 0; x < num_files && dat->error == CACHE_OK; x++) {
+				cache_fs_get(owner, dat, i, x, &cache->meta[i]);
+			}
+		}
+		if (dat->error != CACHE_OK) {
+			result = dat->error;
+			goto exit;
+		}
+	}
 
-		object_free(&data_indices[i]);
+exit:
+	if (!metadata_only) {
+		cache_dat_close(dat);
 	}
+	return result;
+}
 
-	object_free(&data_blocks);
+/**
+ * The shared state of a parallel cache_gen_crc
+ */
+typedef struct crc_job crc_job_t;
+struct crc_job {
+	cache_t* cache;
+	int index;
+	uint32_t* crcs;
+};
+
+/**
+ * Checksums a range of files within an index
+ */
+static void cache_crc_range(crc_job_t* job, size_t begin, size_t end)
+{
+	for (size_t i = begin; i < end; i++) {
+		file_t* file = &job->cache->files[job->index][i];
+		uint32_t crc = crc32(0L, Z_NULL, 0);
+		job->crcs[i] = crc32(crc, (const unsigned char*)file->data, file->length);
+	}
 }
 
 /**
@@ -190,95 +568,360 @@ void cache_open_fs(cache_t* cache, int num_indices, const char** index_files, co
  *  - file: Where to store the checksum file
  */
 void cache_gen_crc(cache_t* cache, int index, file_t* file)
+{
+	cache_gen_crc_parallel(NULL, cache, index, file);
+}
+
+/**
+ * Generates a checksum file for a given index, checksumming the files
+ * across a thread pool
+ *  - pool: The pool to run on, or NULL to run on the calling thread
+ *  - file: Where to store the checksum file
+ */
+void cache_gen_crc_parallel(thread_pool_t* pool, cache_t* cache, int index, file_t* file)
 {
 	int num_files = cache->num_files[index];
 	size_t num_crcs = (num_files+1);
 	size_t buf_len = num_crcs*4;
-	uint32_t crc_buf[num_crcs];
+	uint32_t* crc_buf = NULL;
+	if (cache->files != 0) {
+		crc_buf = (uint32_t*)runite_alloc(cache->allocator, buf_len);
+	}
+	if (crc_buf == NULL) {
+		file->data = NULL;
+		file->length = 0;
+		file->allocator = NULL;
+		file->flags = 0;
+		return;
+	}
+
 	/* calculate the crc table */
+	crc_job_t job = {
+		.cache = cache,
+		.index = index,
+		.crcs = crc_buf
+	};
+	thread_pool_parallel_for(pool, 0, num_files, 0, (range_func_t)cache_crc_range, &job);
+
+	/* keep the raw checksums for update checks */
+	cache_meta_t* meta = &cache->meta[index];
+	if (meta->crcs == NULL) {
+		meta->crcs = (uint32_t*)runite_alloc(cache->allocator, sizeof(uint32_t)*cache_meta_count(num_files));
+	}
+	if (meta->crcs != NULL) {
+		memcpy(meta->crcs, crc_buf, sizeof(uint32_t)*num_files);
+	}
+
+	/* the trailing checksum depends on order, so it's summed afterwards */
 	crc_buf[num_files] = 1234;
 	for (int i = 0; i < num_files; i++) {
-		file_t* file = cache_get_file(cache, index, i);
-		crc_buf[i] = crc32(0L, Z_NULL, 0);
-		crc_buf[i] = crc32(crc_buf[i], (const unsigned char*)file->data, file->length);
 		crc_buf[num_files] = (crc_buf[num_files] << 1) + crc_buf[i];
 		crc_buf[i] = htonl(crc_buf[i]);
 	}
 	crc_buf[num_files] = htonl(crc_buf[num_files]);
-	file->data = (unsigned char*)malloc(buf_len);
-	memcpy(file->data, (char*)&crc_buf, buf_len);
+	file->data = (unsigned char*)crc_buf;
+	file->allocator = cache->allocator;
+	file->flags = 0;
 	file->length = buf_len;
 }
 
 /**
  * Accesses a file within the cache
+ * Loaded files borrow from their index's buffer, so references to them
+ * may be taken with file_ref or file_slice from any thread.
+ * returns: The file, or NULL if it doesn't exist or only metadata was
+ *          loaded, in which case see cache_read_file
  */
 file_t* cache_get_file(cache_t* cache, int index, int file)
 {
-	if (index > cache->num_indices || file > cache->num_files[index]) {
+	if (cache->files == 0 || index < 0 || index >= cache->num_indices) {
+		return NULL;
+	}
+	if (file < 0 || file >= cache->num_files[index]) {
 		return NULL;
 	}
 	return &cache->files[index][file];
 }
 
 /**
- * Extracts the cached file from a cache fs
+ * Reads a file within the cache into out, which the caller frees with
+ * file_free. With CACHE_LOAD_METADATA the file is read from the data file
+ * into memory from the cache's allocator; otherwise out is a reference to
+ * the loaded file. Safe to call from any thread.
+ * returns: false if the file doesn't exist, couldn't be read, or couldn't
+ *          be allocated
  */
-static void cache_fs_get(codec_t* data_indices, codec_t* data_blocks, int index_id, int file_id, file_t* cache_file)
+bool cache_read_file(cache_t* cache, int index, int file, file_t* out)
 {
-	int num_files = data_indices->length/INDEX_ENTRY_SIZE;
-	if (file_id < 0 || file_id > num_files) {
-		goto error;
+	cache_meta_t* meta = cache_get_meta(cache, index);
+	if (meta == NULL || file < 0 || file >= cache->num_files[index]) {
+		return false;
+	}
+	if (cache->dat == NULL) {
+		file_t* loaded = cache_get_file(cache, index, file);
+		return loaded != NULL && file_ref(out, loaded);
 	}
 
-	codec_seek(data_indices, file_id*INDEX_ENTRY_SIZE);
+	size_t length = meta->lengths[file];
+	unsigned char* data = (unsigned char*)runite_alloc(cache->allocator, length);
+	if (data == NULL && length > 0) {
+		return false;
+	}
+	/* a mapped data file is only read, but the chunk buffer is shared */
+	cache_dat_t* dat = cache->dat;
+	if (dat->map == NULL) {
+		pthread_mutex_lock(&dat->lock);
+	}
+	bool read = cache_fs_read(dat, index, file, meta->sectors[file], data, length);
+	if (dat->map == NULL) {
+		pthread_mutex_unlock(&dat->lock);
+	}
+	if (!read) {
+		runite_free(cache->allocator, data, length);
+		return false;
+	}
+	out->length = length;
+	out->data = data;
+	out->allocator = cache->allocator;
+	out->flags = 0;
+	return true;
+}
 
-	cache_file->length = codec_get24fp(data_indices, NULL, 0);
-	int current_block = codec_get24fp(data_indices, NULL, 0);
-	int write_caret = 0;
-	int to_read = cache_file->length;
-	int file_part = 0;
-	int num_blocks = data_blocks->length/DATA_BLOCK_SIZE;
+/**
+ * Accesses an index's file metadata
+ */
+cache_meta_t* cache_get_meta(cache_t* cache, int index)
+{
+	if (cache->meta == NULL || index < 0 || index >= cache->num_indices) {
+		return NULL;
+	}
+	return &cache->meta[index];
+}
 
-	cache_file->data = (unsigned char*)malloc(cache_file->length);
+/**
+ * Stores the version of each file in an index, as read from the client's
+ * version list
+ *  - count: The number of versions, at most the number of files. Any
+ *           files past it are given version 0.
+ */
+bool cache_set_versions(cache_t* cache, int index, const uint16_t* versions, int count)
+{
+	cache_meta_t* meta = cache_get_meta(cache, index);
+	if (meta == NULL || count < 0 || count > cache->num_files[index]) {
+		return false;
+	}
+	int num_files = cache->num_files[index];
+	if (meta->versions == NULL) {
+		meta->versions = (uint16_t*)runite_alloc(cache->allocator, sizeof(uint16_t)*cache_meta_count(num_files));
+		if (meta->versions == NULL) {
+			return false;
+		}
+	}
+	memcpy(meta->versions, versions, sizeof(uint16_t)*count);
+	memset(meta->versions+count, 0, sizeof(uint16_t)*(num_files-count));
+	return true;
+}
+
+/**
+ * Sums the lengths of every file in an index
+ */
+uint64_t cache_index_size(cache_t* cache, int index)
+{
+	cache_meta_t* meta = cache_get_meta(cache, index);
+	if (meta == NULL) {
+		return 0;
+	}
+	uint64_t size = 0;
+	for (int i = 0; i < cache->num_files[index]; i++) {
+		size += meta->lengths[i];
+	}
+	return size;
+}
+
+/**
+ * Reads an index's idx entries into its metadata arrays
+ * returns: false if the arrays couldn't be allocated, leaving them NULL
+ */
+static bool cache_meta_load(cache_t* cache, cache_meta_t* meta, codec_t* data_indices, int num_files)
+{
+	size_t count = cache_meta_count(num_files);
+	meta->lengths = (uint32_t*)runite_alloc(cache->allocator, sizeof(uint32_t)*count);
+	meta->sectors = (uint32_t*)runite_alloc(cache->allocator, sizeof(uint32_t)*count);
+	if (meta->lengths == NULL || meta->sectors == NULL) {
+		/* num_files isn't recorded yet, so cache_free couldn't size these */
+		runite_free(cache->allocator, meta->lengths, sizeof(uint32_t)*count);
+		runite_free(cache->allocator, meta->sectors, sizeof(uint32_t)*count);
+		meta->lengths = NULL;
+		meta->sectors = NULL;
+		return false;
+	}
+	for (int x = 0; x < num_files; x++) {
+		size_t length = 0;
+		uint32_t first_block = 0;
+		cache_fs_entry(data_indices, x, &length, &first_block);
+		meta->lengths[x] = length;
+		meta->sectors[x] = first_block;
+	}
+	return true;
+}
+
+/**
+ * Reads a file's index entry
+ * The index codec is only read through a cursor, so it can be shared
+ * between threads.
+ *  - length: Set to the file's length
+ *  - first_block: Set to the file's first data block, or 0 if it has none
+ */
+static bool cache_fs_entry(codec_t* data_indices, int file_id, size_t* length, uint32_t* first_block)
+{
+	codec_cursor_t index_cursor;
+	codec_cursor_init(&index_cursor, data_indices->data, data_indices->length);
+
+	if (file_id < 0 || !codec_cursor_seek(&index_cursor, (size_t)file_id*INDEX_ENTRY_SIZE)) {
+		return false;
+	}
+	if (!codec_cursor_has(&index_cursor, INDEX_ENTRY_SIZE)) {
+		return false;
+	}
+	*length = codec_cursor_get24_fast(&index_cursor);
+	*first_block = codec_cursor_get24_fast(&index_cursor);
+	return true;
+}
+
+/**
+ * Reassembles a file from its chain of data blocks
+ *  - dest: Where to write the file's length bytes
+ */
+static bool cache_fs_read(cache_dat_t* dat, int index_id, int file_id, uint32_t first_block, unsigned char* dest, size_t length)
+{
+	codec_cursor_t block_cursor;
+	uint32_t current_block = first_block;
+	size_t write_caret = 0;
+	size_t to_read = length;
+	int file_part = 0;
 
 	while (current_block != 0) {
-		if (current_block <= 0 || current_block > num_blocks) {
-			free(cache_file->data);
-			return;
+		size_t block_length;
+		const unsigned char* block = cache_dat_block(dat, current_block, &block_length);
+		if (block == NULL) {
+			return false;
+		}
+		codec_cursor_init(&block_cursor, block, block_length);
+		if (!codec_cursor_has(&block_cursor, 8)) {
+			return false;
 		}
-		codec_seek(data_blocks, current_block*DATA_BLOCK_SIZE);
 
-		int block_file_id = codec_get16(data_blocks);
-		int block_file_pos = codec_get16(data_blocks);
-		int next_block = codec_get24(data_blocks);
-		int block_cache_id = codec_get8(data_blocks);
+		int block_file_id = codec_cursor_get16_fast(&block_cursor);
+		int block_file_pos = codec_cursor_get16_fast(&block_cursor);
+		uint32_t next_block = codec_cursor_get24_fast(&block_cursor);
+		int block_cache_id = codec_cursor_get8_fast(&block_cursor);
 
-		int read_this_block = to_read;
+		size_t read_this_block = to_read;
 		if (read_this_block > 512) {
 			read_this_block = 512;
 		}
-		if (block_file_id != file_id || block_file_pos != file_part || block_cache_id-1 != index_id) {
-			free(cache_file->data);
-			goto error;
+		if (block_file_id != (file_id & 0xFFFF) || block_file_pos != (file_part & 0xFFFF) || block_cache_id-1 != index_id) {
+			return false;
+		}
+		if (codec_cursor_getn(&block_cursor, dest+write_caret, read_this_block) == NULL) {
+			return false;
 		}
-		codec_getn(data_blocks, cache_file->data+(write_caret), read_this_block);
 
 		write_caret += read_this_block;
 		to_read -= read_this_block;
 		current_block = next_block;
 		file_part++;
 	}
-	if (to_read > 0) {
-		free(cache_file->data);
-		goto error;
+	return to_read == 0;
+}
+
+/**
+ * Extracts the cached file from a cache fs into an allocation of its own,
+ * which the index's owner frees. A file which can't be read is left
+ * empty, running out of memory is recorded in dat->error.
+ *  - meta: The index's metadata, with the file's length and first block
+ */
+static void cache_fs_get(cache_index_t* owner, cache_dat_t* dat, int index_id, int file_id, cache_meta_t* meta)
+{
+	file_t* cache_file = &owner->files[file_id];
+	size_t length = meta->lengths[file_id];
+	unsigned char* data = (unsigned char*)runite_alloc(owner->allocator, length);
+	if (data == NULL && length > 0) {
+		dat->error = CACHE_ERROR_MEMORY;
+		return;
+	}
+	if (!cache_fs_read(dat, index_id, file_id, meta->sectors[file_id], data, length)) {
+		runite_free(owner->allocator, data, length);
+		return;
+	}
+	cache_file->length = length;
+	cache_file->data = data;
+}
+
+/**
+ * Allocates an index's slab, from huge pages if asked for and available
+ */
+static bool cache_slab_alloc(cache_t* cache, cache_index_t* owner, size_t size)
+{
+	unsigned char* data = NULL;
+	size_t alloc_size = size > 0 ? size : 1;
+	int flags = 0;
+
+	if (cache->load_flags & CACHE_LOAD_HUGEPAGES) {
+		size_t mapped_size = (size + HUGEPAGE_SIZE - 1) & ~((size_t)HUGEPAGE_SIZE - 1);
+		void* mapped = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mapped != MAP_FAILED) {
+#ifdef MADV_HUGEPAGE
+			madvise(mapped, mapped_size, MADV_HUGEPAGE);
+#endif
+			data = (unsigned char*)mapped;
+			alloc_size = mapped_size;
+			flags = FILE_MAPPED;
+		}
+	}
+	if (data == NULL) {
+		/* always allocate something, so empty files still get a valid pointer */
+		data = (unsigned char*)runite_alloc(cache->allocator, alloc_size);
+		if (data == NULL) {
+			return false;
+		}
+	}
+
+	owner->buffer.data = data;
+	owner->buffer.length = alloc_size;
+	owner->buffer.flags = flags;
+	return true;
+}
+
+/**
+ * Extracts every file of an index into the index's slab, sized from the
+ * index's metadata, reassembling each file in place. The files borrow
+ * from the slab, so only references taken with file_ref or file_slice
+ * pin it. Running out of memory is recorded in dat->error.
+ */
+static void cache_fs_get_index(cache_t* cache, cache_index_t* owner, cache_dat_t* dat, int index_id)
+{
+	int num_files = owner->num_files;
+	cache_meta_t* meta = &cache->meta[index_id];
+	size_t total = 0;
+	for (int x = 0; x < num_files; x++) {
+		total += meta->lengths[x];
+	}
+	if (!cache_slab_alloc(cache, owner, total)) {
+		dat->error = CACHE_ERROR_MEMORY;
+		return;
+	}
+
+	size_t offset = 0;
+	for (int x = 0; x < num_files; x++) {
+		unsigned char* dest = owner->buffer.data + offset;
+		offset += meta->lengths[x];
+		if (!cache_fs_read(dat, index_id, x, meta->sectors[x], dest, meta->lengths[x])) {
+			continue;
+		}
+		owner->files[x].length = meta->lengths[x];
+		owner->files[x].data = dest;
 	}
-	goto exit;
-error:
-	cache_file->length = 0;
-	cache_file->data = NULL;
-exit:
-	return;
 }
 
 object_proto_t cache_proto = {
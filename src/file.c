@@ -19,6 +19,9 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 /**
@@ -30,22 +33,226 @@ bool file_read(file_t* file, const char* path)
 	if (stat(path, &fstat) != 0) {
 		return false;
 	}
-	file->data = (unsigned char*)malloc(fstat.st_size);
+	file->allocator = runite_allocator_get();
+	file->flags = 0;
+	file->data = (unsigned char*)runite_alloc(file->allocator, fstat.st_size);
 	file->length = fstat.st_size;
+	if (file->data == NULL && file->length != 0) {
+		return false;
+	}
 	FILE* fd = fopen(path, "r");
 	if (!fd) {
-		free(file->data);
+		file_free(file);
 		return false;
 	}
 	if (fread(file->data, 1, file->length, fd) != file->length) {
 		fclose(fd);
-		free(file->data);
+		file_free(file);
 		return false;
 	}
 	fclose(fd);
 	return true;
 }
 
+/**
+ * Maps a file from disk into a file_t instead of reading it. The mapping
+ * is private, so writes to data never reach the file.
+ */
+bool file_map(file_t* file, const char* path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat fstat_buf;
+	if (fstat(fd, &fstat_buf) != 0) {
+		close(fd);
+		return false;
+	}
+
+	file->allocator = NULL;
+	file->length = fstat_buf.st_size;
+	file->data = NULL;
+	file->flags = 0;
+	/* empty files can't be mapped, but there's nothing to read anyway */
+	if (file->length == 0) {
+		close(fd);
+		return true;
+	}
+
+	void* data = mmap(NULL, file->length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		file->length = 0;
+		return false;
+	}
+	file->data = (unsigned char*)data;
+	file->flags = FILE_MAPPED;
+	return true;
+}
+
+/**
+ * Frees a file's contents the way they were obtained: dropping a shared
+ * reference, unmapping them, leaving them with their owner, or through
+ * the allocator they came from
+ */
+void file_free(file_t* file)
+{
+	if (file->flags & FILE_SHARED) {
+		file_buffer_release(file->buffer);
+	} else if (file->flags & FILE_MAPPED) {
+		munmap(file->data, file->length);
+	} else if (file->flags & FILE_BORROWED) {
+		/* not ours to free */
+	} else if (file->allocator != NULL) {
+		runite_free(file->allocator, file->data, file->length);
+	} else {
+		free(file->data);
+	}
+	file->data = NULL;
+	file->length = 0;
+	file->flags = 0;
+	file->buffer = NULL;
+}
+
+/**
+ * Returns the allocator a buffer's own structure comes from: the one its
+ * data came from, or the default allocator for malloc'd data
+ */
+static runite_allocator_t* file_buffer_allocator(runite_allocator_t* allocator)
+{
+	return allocator != NULL ? allocator : runite_allocator_default();
+}
+
+/**
+ * Wraps memory in a file_buffer_t, which takes ownership of it
+ *  - allocator: Where data came from, or NULL for malloc. The buffer
+ *               itself is allocated from it too, even if data is mapped.
+ *  - flags: FILE_MAPPED if data is a mapping
+ * returns: The buffer with one reference, or NULL if it couldn't be
+ *          allocated, in which case data is still the caller's
+ */
+file_buffer_t* file_buffer_new(unsigned char* data, size_t length, runite_allocator_t* allocator, int flags)
+{
+	file_buffer_t* buffer = (file_buffer_t*)runite_alloc(file_buffer_allocator(allocator), sizeof(file_buffer_t));
+	if (buffer == NULL) {
+		return NULL;
+	}
+	buffer->refs = 1;
+	buffer->length = length;
+	buffer->data = data;
+	buffer->allocator = allocator;
+	buffer->flags = flags & FILE_MAPPED;
+	buffer->release = NULL;
+	return buffer;
+}
+
+/**
+ * Initializes a buffer embedded in whatever owns its contents, with one
+ * reference
+ *  - release: Called with the last reference to free the contents and
+ *             the owner
+ */
+void file_buffer_init(file_buffer_t* buffer, unsigned char* data, size_t length, file_buffer_release_t release)
+{
+	buffer->refs = 1;
+	buffer->length = length;
+	buffer->data = data;
+	buffer->allocator = NULL;
+	buffer->flags = 0;
+	buffer->release = release;
+}
+
+/**
+ * Takes another reference to a buffer, from any thread
+ */
+file_buffer_t* file_buffer_acquire(file_buffer_t* buffer)
+{
+	__atomic_add_fetch(&buffer->refs, 1, __ATOMIC_RELAXED);
+	return buffer;
+}
+
+/**
+ * Drops a reference to a buffer, from any thread, freeing it with the
+ * last one
+ */
+void file_buffer_release(file_buffer_t* buffer)
+{
+	if (__atomic_sub_fetch(&buffer->refs, 1, __ATOMIC_ACQ_REL) != 0) {
+		return;
+	}
+	if (buffer->release != NULL) {
+		buffer->release(buffer);
+		return;
+	}
+	if (buffer->flags & FILE_MAPPED) {
+		munmap(buffer->data, buffer->length);
+	} else if (buffer->allocator != NULL) {
+		runite_free(buffer->allocator, buffer->data, buffer->length);
+	} else {
+		free(buffer->data);
+	}
+	runite_free(file_buffer_allocator(buffer->allocator), buffer, sizeof(file_buffer_t));
+}
+
+/**
+ * Moves a file's contents into a shared buffer, so that references to
+ * them can be handed out without copying. data doesn't move. Not safe to
+ * call on the same file from two threads until it has been shared once.
+ * returns: false if the contents are borrowed from something other than
+ *          a buffer, and so can't be shared, or the buffer couldn't be
+ *          allocated
+ */
+bool file_share(file_t* file)
+{
+	if (file->flags & FILE_SHARED) {
+		return true;
+	}
+	if (file->flags & FILE_BORROWED) {
+		return file->buffer != NULL;
+	}
+	file_buffer_t* buffer = file_buffer_new(file->data, file->length, file->allocator, file->flags);
+	if (buffer == NULL) {
+		return false;
+	}
+	file->flags = FILE_SHARED;
+	file->buffer = buffer;
+	return true;
+}
+
+/**
+ * Makes out another reference to a file's contents, sharing them first
+ * if need be. out is released with file_free like any other file.
+ */
+bool file_ref(file_t* out, file_t* file)
+{
+	return file_slice(out, file, 0, file->length);
+}
+
+/**
+ * Makes out a reference to part of a file's contents, sharing them first
+ * if need be
+ *  - offset: Where the slice starts within file
+ *  - length: The length of the slice
+ * returns: false if the slice runs past the end of file or the contents
+ *          can't be shared
+ */
+bool file_slice(file_t* out, file_t* file, size_t offset, size_t length)
+{
+	if (offset > file->length || length > file->length - offset) {
+		return false;
+	}
+	if (!file_share(file)) {
+		return false;
+	}
+	out->length = length;
+	out->data = file->data + offset;
+	out->allocator = NULL;
+	out->flags = FILE_SHARED;
+	out->buffer = file_buffer_acquire(file->buffer);
+	return true;
+}
+
 /**
  * Write a file_t to disk
  */
@@ -0,0 +1,399 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * file_batch.c
+ *
+ * Reads many files at once. On Linux the reads are queued through an
+ * io_uring so that a whole batch costs a handful of syscalls; elsewhere,
+ * or when io_uring isn't available, the files are read on a thread pool.
+ */
+
+#include <runite/file.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#if defined(__linux__) && !defined(RUNITE_NO_IO_URING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+#define FILE_BATCH_RING_ENTRIES 64
+#define FILE_BATCH_MAX_READ (1 << 30)
+
+typedef struct file_batch file_batch_t;
+
+/**
+ * The shared state of a file_read_batch
+ */
+struct file_batch {
+	file_t* files;
+	const char** paths;
+	bool* results;
+};
+
+/**
+ * Reads a range of a batch's files with file_read
+ */
+static void file_batch_read_range(file_batch_t* batch, size_t begin, size_t end)
+{
+	for (size_t i = begin; i < end; i++) {
+		batch->results[i] = file_read(&batch->files[i], batch->paths[i]);
+	}
+}
+
+#ifdef HAVE_IO_URING
+
+typedef struct file_ring file_ring_t;
+typedef struct file_ring_read file_ring_read_t;
+
+/**
+ * A minimal io_uring, mapped by hand so we don't depend on liburing
+ */
+struct file_ring {
+	int fd;
+	unsigned entries;
+	void* sq_ptr;
+	size_t sq_size;
+	void* cq_ptr;
+	size_t cq_size;
+	struct io_uring_sqe* sqes;
+	size_t sqes_size;
+	unsigned* sq_tail;
+	unsigned* sq_mask;
+	unsigned* sq_array;
+	unsigned* cq_head;
+	unsigned* cq_tail;
+	unsigned* cq_mask;
+	struct io_uring_cqe* cqes;
+};
+
+/**
+ * The progress of one file's read
+ */
+struct file_ring_read {
+	int fd;
+	size_t done;
+	struct iovec iov;
+};
+
+/**
+ * Sets up an io_uring
+ * returns: false if the kernel doesn't support io_uring or won't let us
+ *          use it
+ */
+static bool file_ring_open(file_ring_t* ring, unsigned entries)
+{
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	memset(ring, 0, sizeof(file_ring_t));
+
+	ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+	if (ring->fd < 0) {
+		return false;
+	}
+	ring->entries = params.sq_entries;
+
+	ring->sq_size = params.sq_off.array + params.sq_entries*sizeof(unsigned);
+	ring->cq_size = params.cq_off.cqes + params.cq_entries*sizeof(struct io_uring_cqe);
+	bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+	if (single_mmap) {
+		if (ring->cq_size > ring->sq_size) {
+			ring->sq_size = ring->cq_size;
+		}
+		ring->cq_size = ring->sq_size;
+	}
+
+	ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (ring->sq_ptr == MAP_FAILED) {
+		goto error;
+	}
+	if (single_mmap) {
+		ring->cq_ptr = ring->sq_ptr;
+	} else {
+		ring->cq_ptr = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+		if (ring->cq_ptr == MAP_FAILED) {
+			munmap(ring->sq_ptr, ring->sq_size);
+			goto error;
+		}
+	}
+	ring->sqes_size = params.sq_entries*sizeof(struct io_uring_sqe);
+	ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		if (!single_mmap) {
+			munmap(ring->cq_ptr, ring->cq_size);
+		}
+		munmap(ring->sq_ptr, ring->sq_size);
+		goto error;
+	}
+
+	unsigned char* sq = (unsigned char*)ring->sq_ptr;
+	unsigned char* cq = (unsigned char*)ring->cq_ptr;
+	ring->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+	ring->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+	ring->sq_array = (unsigned*)(sq + params.sq_off.array);
+	ring->cq_head = (unsigned*)(cq + params.cq_off.head);
+	ring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+	ring->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+	return true;
+
+error:
+	close(ring->fd);
+	return false;
+}
+
+/**
+ * Tears down an io_uring
+ */
+static void file_ring_close(file_ring_t* ring)
+{
+	munmap(ring->sqes, ring->sqes_size);
+	if (ring->cq_ptr != ring->sq_ptr) {
+		munmap(ring->cq_ptr, ring->cq_size);
+	}
+	munmap(ring->sq_ptr, ring->sq_size);
+	close(ring->fd);
+}
+
+/**
+ * Queues a read of the rest of a file. The caller makes sure there's
+ * room, by keeping no more than ring->entries reads in flight.
+ */
+static void file_ring_queue_read(file_ring_t* ring, file_t* file, file_ring_read_t* read, size_t id)
+{
+	size_t remaining = file->length - read->done;
+	read->iov.iov_base = file->data + read->done;
+	read->iov.iov_len = remaining > FILE_BATCH_MAX_READ ? FILE_BATCH_MAX_READ : remaining;
+
+	unsigned tail = *ring->sq_tail;
+	unsigned index = tail & *ring->sq_mask;
+	struct io_uring_sqe* sqe = &ring->sqes[index];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->opcode = IORING_OP_READV;
+	sqe->fd = read->fd;
+	sqe->addr = (uint64_t)(uintptr_t)&read->iov;
+	sqe->len = 1;
+	sqe->off = read->done;
+	sqe->user_data = id;
+	ring->sq_array[index] = index;
+	__atomic_store_n(ring->sq_tail, tail+1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Opens a file and allocates room for it, ready to be read
+ * returns: false if the file couldn't be opened or allocated
+ */
+static bool file_ring_prepare(file_t* file, file_ring_read_t* read, const char* path)
+{
+	read->fd = open(path, O_RDONLY);
+	read->done = 0;
+	if (read->fd < 0) {
+		return false;
+	}
+	struct stat fstat_buf;
+	if (fstat(read->fd, &fstat_buf) != 0) {
+		goto error;
+	}
+	file->allocator = runite_allocator_get();
+	file->flags = 0;
+	file->length = fstat_buf.st_size;
+	file->data = (unsigned char*)runite_alloc(file->allocator, file->length);
+	if (file->data == NULL && file->length != 0) {
+		goto error;
+	}
+	return true;
+error:
+	file->data = NULL;
+	file->length = 0;
+	close(read->fd);
+	read->fd = -1;
+	return false;
+}
+
+/**
+ * Reads a batch of files through an io_uring
+ * returns: false if io_uring couldn't be set up, in which case nothing
+ *          has been read
+ */
+static bool file_ring_read_batch(file_batch_t* batch, size_t count)
+{
+	file_ring_t ring;
+	if (!file_ring_open(&ring, FILE_BATCH_RING_ENTRIES)) {
+		return false;
+	}
+	file_ring_read_t* reads = (file_ring_read_t*)malloc(sizeof(file_ring_read_t)*count);
+	size_t* requeue = (size_t*)malloc(sizeof(size_t)*ring.entries);
+	if (reads == NULL || requeue == NULL) {
+		free(reads);
+		free(requeue);
+		file_ring_close(&ring);
+		return false;
+	}
+
+	size_t next = 0;
+	size_t remaining = count;
+	size_t num_requeued = 0;
+	unsigned unsubmitted = 0;
+	unsigned in_flight = 0;
+	while (remaining > 0) {
+		/* top the ring up, partial reads first */
+		while (in_flight + unsubmitted < ring.entries && num_requeued > 0) {
+			size_t id = requeue[--num_requeued];
+			file_ring_queue_read(&ring, &batch->files[id], &reads[id], id);
+			unsubmitted++;
+		}
+		while (in_flight + unsubmitted < ring.entries && next < count) {
+			size_t id = next++;
+			if (!file_ring_prepare(&batch->files[id], &reads[id], batch->paths[id])) {
+				batch->results[id] = false;
+				remaining--;
+				continue;
+			}
+			if (batch->files[id].length == 0) {
+				close(reads[id].fd);
+				reads[id].fd = -1;
+				batch->results[id] = true;
+				remaining--;
+				continue;
+			}
+			file_ring_queue_read(&ring, &batch->files[id], &reads[id], id);
+			unsubmitted++;
+		}
+		if (unsubmitted == 0 && in_flight == 0) {
+			break;
+		}
+
+		int submitted = syscall(__NR_io_uring_enter, ring.fd, unsubmitted, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+		if (submitted < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		unsubmitted -= submitted;
+		in_flight += submitted;
+
+		unsigned head = *ring.cq_head;
+		while (head != __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE)) {
+			struct io_uring_cqe* cqe = &ring.cqes[head & *ring.cq_mask];
+			size_t id = cqe->user_data;
+			int res = cqe->res;
+			head++;
+			in_flight--;
+
+			file_t* file = &batch->files[id];
+			file_ring_read_t* read = &reads[id];
+			if (res == -EINTR || res == -EAGAIN) {
+				requeue[num_requeued++] = id;
+				continue;
+			}
+			if (res > 0) {
+				read->done += res;
+				if (read->done < file->length) {
+					requeue[num_requeued++] = id;
+					continue;
+				}
+			}
+			/* done, or failed, or the file shrank under us */
+			close(read->fd);
+			read->fd = -1;
+			batch->results[id] = read->done == file->length;
+			if (!batch->results[id]) {
+				file_free(file);
+			}
+			remaining--;
+		}
+		__atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+	}
+	file_ring_close(&ring);
+
+	if (remaining > 0) {
+		/*
+		 * The ring stopped accepting work. Reads the kernel already took
+		 * may still land in their buffers, so those are given up on
+		 * rather than freed, and the files not yet started are read the
+		 * ordinary way.
+		 */
+		for (size_t id = 0; id < next; id++) {
+			if (reads[id].fd >= 0) {
+				close(reads[id].fd);
+				batch->results[id] = false;
+				batch->files[id].data = NULL;
+				batch->files[id].length = 0;
+			}
+		}
+		for (size_t id = next; id < count; id++) {
+			batch->results[id] = file_read(&batch->files[id], batch->paths[id]);
+		}
+	}
+	free(reads);
+	free(requeue);
+	return true;
+}
+
+#endif /* HAVE_IO_URING */
+
+/**
+ * Reads many files from disk into file_t's
+ *  - pool: The pool to read on if io_uring isn't available, or NULL to
+ *          read on the calling thread
+ *  - results: Filled with each file's result in input order, or NULL
+ * returns: Whether every file was read
+ */
+bool file_read_batch(thread_pool_t* pool, file_t* files, const char** paths, size_t count, bool* results)
+{
+	bool* batch_results = results;
+	if (batch_results == NULL) {
+		batch_results = (bool*)malloc(sizeof(bool)*(count > 0 ? count : 1));
+		if (batch_results == NULL) {
+			return false;
+		}
+	}
+
+	file_batch_t batch = {
+		.files = files,
+		.paths = paths,
+		.results = batch_results
+	};
+
+	bool done = false;
+#ifdef HAVE_IO_URING
+	done = file_ring_read_batch(&batch, count);
+#endif
+	if (!done) {
+		thread_pool_parallel_for(pool, 0, count, 0, (range_func_t)file_batch_read_range, &batch);
+	}
+
+	bool success = true;
+	for (size_t i = 0; i < count; i++) {
+		success = success && batch_results[i];
+	}
+	if (results == NULL) {
+		free(batch_results);
+	}
+	return success;
+}
@@ -1,4 +1,4 @@
-OBJECTS += $(addprefix src/,cache.o hash.o file.o archive.o)
+OBJECTS += $(addprefix src/,cache.o hash.o file.o file_batch.o archive.o)
 
 SUBDIRS = src/util
 include $(addsuffix /makefile.mk, $(SUBDIRS))
@@ -0,0 +1,232 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * allocator.c
+ *
+ * The default allocator is plain malloc/realloc/free, so memory from it
+ * can still be released with free() by code that predates allocators.
+ * Counters are updated atomically; an allocator may be shared between
+ * threads as long as its hooks are thread safe.
+ */
+
+#include <runite/util/allocator.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* bzlib only hands back the pointer, so its allocations carry their size */
+#define BZ_HEADER_SIZE 16
+
+static void* default_alloc(void* ctx, size_t size)
+{
+	return malloc(size);
+}
+
+static void* default_realloc(void* ctx, void* ptr, size_t old_size, size_t size)
+{
+	return realloc(ptr, size);
+}
+
+static void default_free(void* ctx, void* ptr, size_t size)
+{
+	free(ptr);
+}
+
+static runite_allocator_t default_allocator = {
+	.alloc = default_alloc,
+	.realloc = default_realloc,
+	.free = default_free,
+	.ctx = NULL,
+	.limit = 0
+};
+
+static runite_allocator_t* global_allocator = &default_allocator;
+
+/**
+ * Initializes an allocator from a set of hooks, with zeroed counters
+ *  - ctx: Passed to every hook
+ */
+void runite_allocator_init(runite_allocator_t* allocator, runite_alloc_t alloc, runite_realloc_t realloc, runite_free_t free, void* ctx)
+{
+	allocator->alloc = alloc;
+	allocator->realloc = realloc;
+	allocator->free = free;
+	allocator->ctx = ctx;
+	allocator->limit = 0;
+	allocator->bytes_in_use = 0;
+	allocator->bytes_high_water = 0;
+	allocator->num_allocs = 0;
+}
+
+/**
+ * Caps the bytes an allocator will hand out, 0 for no limit
+ * Allocations which would go over the limit fail.
+ */
+void runite_allocator_set_limit(runite_allocator_t* allocator, size_t limit)
+{
+	__atomic_store_n(&allocator->limit, limit, __ATOMIC_RELAXED);
+}
+
+size_t runite_allocator_in_use(runite_allocator_t* allocator)
+{
+	return __atomic_load_n(&allocator->bytes_in_use, __ATOMIC_RELAXED);
+}
+
+size_t runite_allocator_high_water(runite_allocator_t* allocator)
+{
+	return __atomic_load_n(&allocator->bytes_high_water, __ATOMIC_RELAXED);
+}
+
+/**
+ * Gets the malloc backed allocator used unless another is set
+ */
+runite_allocator_t* runite_allocator_default()
+{
+	return &default_allocator;
+}
+
+/**
+ * Gets the allocator new objects pick up
+ */
+runite_allocator_t* runite_allocator_get()
+{
+	return __atomic_load_n(&global_allocator, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Sets the allocator new objects pick up, NULL for the default
+ * Existing objects keep the allocator they were created with.
+ */
+void runite_allocator_set(runite_allocator_t* allocator)
+{
+	__atomic_store_n(&global_allocator, allocator ? allocator : &default_allocator, __ATOMIC_RELEASE);
+}
+
+/**
+ * Charges size bytes to an allocator
+ * returns: false if that would go over its limit
+ */
+static bool runite_charge(runite_allocator_t* allocator, size_t size)
+{
+	size_t limit = __atomic_load_n(&allocator->limit, __ATOMIC_RELAXED);
+	size_t in_use = __atomic_add_fetch(&allocator->bytes_in_use, size, __ATOMIC_RELAXED);
+	if (limit != 0 && in_use > limit) {
+		__atomic_sub_fetch(&allocator->bytes_in_use, size, __ATOMIC_RELAXED);
+		return false;
+	}
+	size_t high_water = __atomic_load_n(&allocator->bytes_high_water, __ATOMIC_RELAXED);
+	while (in_use > high_water && !__atomic_compare_exchange_n(&allocator->bytes_high_water, &high_water, in_use, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	return true;
+}
+
+static void runite_uncharge(runite_allocator_t* allocator, size_t size)
+{
+	__atomic_sub_fetch(&allocator->bytes_in_use, size, __ATOMIC_RELAXED);
+}
+
+/**
+ * Allocates size bytes
+ *  - allocator: The allocator to use, or NULL for the global allocator
+ */
+void* runite_alloc(runite_allocator_t* allocator, size_t size)
+{
+	if (allocator == NULL) {
+		allocator = runite_allocator_get();
+	}
+	if (!runite_charge(allocator, size)) {
+		return NULL;
+	}
+	void* ptr = allocator->alloc(allocator->ctx, size);
+	if (ptr == NULL) {
+		runite_uncharge(allocator, size);
+		return NULL;
+	}
+	__atomic_add_fetch(&allocator->num_allocs, 1, __ATOMIC_RELAXED);
+	return ptr;
+}
+
+/**
+ * Resizes an allocation. On failure the original allocation is untouched.
+ *  - ptr: The allocation, or NULL to allocate
+ *  - old_size: The size ptr was allocated with
+ */
+void* runite_realloc(runite_allocator_t* allocator, void* ptr, size_t old_size, size_t size)
+{
+	if (allocator == NULL) {
+		allocator = runite_allocator_get();
+	}
+	if (ptr == NULL) {
+		return runite_alloc(allocator, size);
+	}
+	if (size > old_size && !runite_charge(allocator, size - old_size)) {
+		return NULL;
+	}
+	void* new_ptr = allocator->realloc(allocator->ctx, ptr, old_size, size);
+	if (new_ptr == NULL) {
+		if (size > old_size) {
+			runite_uncharge(allocator, size - old_size);
+		}
+		return NULL;
+	}
+	if (size < old_size) {
+		runite_uncharge(allocator, old_size - size);
+	}
+	return new_ptr;
+}
+
+/**
+ * Frees an allocation
+ *  - size: The size ptr was allocated with
+ */
+void runite_free(runite_allocator_t* allocator, void* ptr, size_t size)
+{
+	if (ptr == NULL) {
+		return;
+	}
+	if (allocator == NULL) {
+		allocator = runite_allocator_get();
+	}
+	allocator->free(allocator->ctx, ptr, size);
+	runite_uncharge(allocator, size);
+}
+
+/**
+ * bzalloc hook, use with the allocator as the stream's opaque pointer
+ */
+void* runite_bzalloc(void* allocator, int items, int size)
+{
+	size_t len = BZ_HEADER_SIZE + (size_t)items*size;
+	unsigned char* ptr = (unsigned char*)runite_alloc((runite_allocator_t*)allocator, len);
+	if (ptr == NULL) {
+		return NULL;
+	}
+	*(size_t*)ptr = len;
+	return ptr + BZ_HEADER_SIZE;
+}
+
+/**
+ * bzfree hook, see runite_bzalloc
+ */
+void runite_bzfree(void* allocator, void* ptr)
+{
+	if (ptr == NULL) {
+		return;
+	}
+	unsigned char* base = (unsigned char*)ptr - BZ_HEADER_SIZE;
+	runite_free((runite_allocator_t*)allocator, base, *(size_t*)base);
+}
@@ -0,0 +1,203 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * arena.c
+ *
+ * A bump allocator which hands out memory from a few large chunks.
+ * Individual allocations can be released to be reused by later ones, but
+ * memory only goes back to the allocator when the arena is reset or freed.
+ */
+
+#include <runite/util/arena.h>
+
+#include <runite/util/math.h>
+
+/**
+ * Initializes a new arena
+ */
+static void arena_init(arena_t* arena)
+{
+	arena->allocator = runite_allocator_get();
+	arena->head = NULL;
+	arena->free_list = NULL;
+	arena->chunk_size = DEFAULT_ARENA_CHUNK_SIZE;
+}
+
+/**
+ * Properly frees an arena, releasing every allocation made from it
+ */
+static void arena_free(arena_t* arena)
+{
+	arena_reset(arena);
+}
+
+/**
+ * Allocates a new chunk with at least size bytes of space
+ */
+static arena_chunk_t* arena_new_chunk(arena_t* arena, size_t size)
+{
+	arena_chunk_t* chunk = (arena_chunk_t*)runite_alloc(arena->allocator, sizeof(arena_chunk_t) + size);
+	if (chunk == NULL) {
+		return NULL;
+	}
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->used = 0;
+	return chunk;
+}
+
+/**
+ * Takes the first released block with room for size bytes off the free
+ * list, leaving whatever it doesn't need on the list
+ * returns: The memory, or NULL if no block is big enough
+ */
+static void* arena_take_free(arena_t* arena, size_t size)
+{
+	for (arena_block_t** link = &arena->free_list; *link != NULL; link = &(*link)->next) {
+		arena_block_t* block = *link;
+		if (block->size < size) {
+			continue;
+		}
+		size_t rest = block->size - size;
+		if (rest >= sizeof(arena_block_t)) {
+			arena_block_t* tail = (arena_block_t*)((unsigned char*)block + size);
+			tail->next = block->next;
+			tail->size = rest;
+			*link = tail;
+		} else {
+			/* a remainder too small to track waits for arena_reset */
+			*link = block->next;
+		}
+		return block;
+	}
+	return NULL;
+}
+
+/**
+ * Allocates size bytes from the arena
+ * Released memory is reused first. Large allocations get a dedicated
+ * chunk so that the space left in the current chunk isn't wasted.
+ * returns: The allocated memory, or NULL on failure
+ */
+void* arena_alloc(arena_t* arena, size_t size)
+{
+	size = ARENA_ROUND(size);
+	if (arena->free_list != NULL && size > 0) {
+		void* ptr = arena_take_free(arena, size);
+		if (ptr != NULL) {
+			return ptr;
+		}
+	}
+
+	arena_chunk_t* chunk = arena->head;
+	if (chunk != NULL && chunk->size - chunk->used >= size) {
+		void* ptr = chunk->data + chunk->used;
+		chunk->used += size;
+		return ptr;
+	}
+
+	if (size > arena->chunk_size / 4) {
+		chunk = arena_new_chunk(arena, size);
+		if (chunk == NULL) {
+			return NULL;
+		}
+		chunk->used = size;
+		/* keep the current head so its free space is still used */
+		if (arena->head != NULL) {
+			chunk->next = arena->head->next;
+			arena->head->next = chunk;
+		} else {
+			arena->head = chunk;
+		}
+		return chunk->data;
+	}
+
+	chunk = arena_new_chunk(arena, arena->chunk_size);
+	if (chunk == NULL) {
+		return NULL;
+	}
+	chunk->next = arena->head;
+	chunk->used = size;
+	arena->head = chunk;
+	return chunk->data;
+}
+
+/**
+ * Gives an allocation back to the arena for arena_alloc to reuse. The
+ * latest allocation from the current chunk is returned to the chunk,
+ * anything else goes on the free list.
+ *  - size: The size ptr was allocated with
+ */
+void arena_release(arena_t* arena, void* ptr, size_t size)
+{
+	size = ARENA_ROUND(size);
+	if (ptr == NULL || size == 0) {
+		return;
+	}
+	arena_chunk_t* chunk = arena->head;
+	if (chunk != NULL && (unsigned char*)ptr + size == chunk->data + chunk->used) {
+		chunk->used -= size;
+		return;
+	}
+	if (size < sizeof(arena_block_t)) {
+		/* too small to track, it waits for arena_reset */
+		return;
+	}
+	arena_block_t* block = (arena_block_t*)ptr;
+	block->next = arena->free_list;
+	block->size = size;
+	arena->free_list = block;
+}
+
+/**
+ * Ensures the next allocations totalling up to size bytes can be
+ * served from a single chunk
+ */
+void arena_reserve(arena_t* arena, size_t size)
+{
+	arena_chunk_t* chunk = arena->head;
+	if (chunk != NULL && chunk->size - chunk->used >= size) {
+		return;
+	}
+	chunk = arena_new_chunk(arena, max(ARENA_ROUND(size), arena->chunk_size));
+	if (chunk == NULL) {
+		return;
+	}
+	chunk->next = arena->head;
+	arena->head = chunk;
+}
+
+/**
+ * Releases every allocation made from the arena
+ */
+void arena_reset(arena_t* arena)
+{
+	arena_chunk_t* chunk = arena->head;
+	while (chunk != NULL) {
+		arena_chunk_t* next = chunk->next;
+		runite_free(arena->allocator, chunk, sizeof(arena_chunk_t) + chunk->size);
+		chunk = next;
+	}
+	arena->head = NULL;
+	arena->free_list = NULL;
+}
+
+object_proto_t arena_proto = {
+	.init = (object_init_t)arena_init,
+	.free = (object_free_t)arena_free
+};
@@ -26,16 +26,69 @@
 
 #include <assert.h>
 
+#include <runite/util/math.h>
+#include <runite/util/codec_fast.h>
+#include <runite/util/codec_variants.h>
+
+/*
+ * Switch cases dispatching each single-transform flag combination to its
+ * specialized variant. Combinations with no variant (several transforms,
+ * or several orders) fall through to the default case.
+ */
+#define PUT_CASES(bits, order_flag, order_suffix)						\
+	case (order_flag) | CODEC_NEGATIVE:								\
+		codec_put##bits##order_suffix##_neg(codec, i);					\
+		break;															\
+	case (order_flag) | CODEC_INV128:									\
+		codec_put##bits##order_suffix##_inv128(codec, i);				\
+		break;															\
+	case (order_flag) | CODEC_OFS128:									\
+		codec_put##bits##order_suffix##_ofs128(codec, i);				\
+		break;
+
+#define PUT_ORDER_CASES(bits, order_flag, order_suffix)					\
+	case (order_flag):													\
+		codec_put##bits##order_suffix(codec, i);						\
+		break;															\
+	PUT_CASES(bits, order_flag, order_suffix)
+
+#define GET_CASES(bits, order_flag, order_suffix)						\
+	case (order_flag) | CODEC_NEGATIVE:								\
+		x = codec_get##bits##order_suffix##_neg(codec);					\
+		break;															\
+	case (order_flag) | CODEC_INV128:									\
+		x = codec_get##bits##order_suffix##_inv128(codec);				\
+		break;															\
+	case (order_flag) | CODEC_OFS128:									\
+		x = codec_get##bits##order_suffix##_ofs128(codec);				\
+		break;
+
+#define GET_ORDER_CASES(bits, order_flag, order_suffix)					\
+	case (order_flag):													\
+		x = codec_get##bits##order_suffix(codec);						\
+		break;															\
+	GET_CASES(bits, order_flag, order_suffix)
+
 /**
  * Initializes a new codec
+ * If the default buffer can't be allocated, data is left NULL with a length of 0
  */
 static void codec_init(codec_t* codec)
 {
-	codec->data = (unsigned char*)malloc(DEFAULT_BUFFER_SIZE);
-	memset(codec->data, 0, DEFAULT_BUFFER_SIZE);
-	codec->length = DEFAULT_BUFFER_SIZE;
+	codec->allocator = runite_allocator_get();
+	codec->data = (unsigned char*)runite_alloc(codec->allocator, DEFAULT_BUFFER_SIZE);
+	codec->length = 0;
+	if (codec->data != NULL) {
+		memset(codec->data, 0, DEFAULT_BUFFER_SIZE);
+		codec->length = DEFAULT_BUFFER_SIZE;
+	}
+	codec->size = 0;
 	codec->caret = 0;
 	codec->bit_access_mode = false;
+	codec->growable = false;
+	codec->read_only = false;
+	codec->borrowed = false;
+	codec->overflow = false;
 }
 
 /**
@@ -43,19 +96,158 @@ static void codec_init(codec_t* codec)
  */
 static void codec_free(codec_t* codec)
 {
-	free(codec->data);
+	if (!codec->borrowed) {
+		runite_free(codec->allocator, codec->data, codec->length);
+	}
+}
+
+/**
+ * Initializes a codec over memory it doesn't own
+ */
+static void codec_init_borrowed(codec_t* codec, void* data, size_t len, bool read_only)
+{
+	codec->object.prototype = &codec_proto;
+	codec->object.must_free = false;
+	codec->allocator = runite_allocator_get();
+	codec->data = (unsigned char*)data;
+	codec->length = len;
+	codec->size = len;
+	codec->caret = 0;
+	codec->bit_access_mode = false;
+	codec->growable = false;
+	codec->read_only = read_only;
+	codec->borrowed = true;
+	codec->overflow = false;
+}
+
+/**
+ * Initializes a codec which reads and writes a caller owned buffer in
+ * place, without allocating. The buffer must outlive the codec. Should the
+ * codec be made growable and outgrow the buffer, the data is copied into a
+ * buffer of its own.
+ */
+void codec_wrap(codec_t* codec, void* data, size_t len)
+{
+	codec_init_borrowed(codec, data, len, false);
+}
+
+/**
+ * Initializes a read only codec for parsing a caller owned buffer in
+ * place, without allocating. Puts to the codec are refused.
+ */
+void codec_view(codec_t* codec, const void* data, size_t len)
+{
+	codec_init_borrowed(codec, (void*)data, len, true);
 }
 
 /**
  * Resizes a codec_t
  * All data is lost upon resize, buffer is zero-initialized
+ * If allocation fails, data is left NULL with a length of 0
  */
 void codec_resize(codec_t* codec, size_t size)
 {
-	free(codec->data);
-	codec->data = (unsigned char*)malloc(size);
-	codec->length = size;
-	memset(codec->data, 0, codec->length);
+	if (!codec->borrowed) {
+		runite_free(codec->allocator, codec->data, codec->length);
+	}
+	codec->data = (unsigned char*)runite_alloc(codec->allocator, size);
+	codec->length = codec->data != NULL ? size : 0;
+	codec->size = 0;
+	codec->read_only = false;
+	codec->borrowed = false;
+	if (codec->data != NULL) {
+		memset(codec->data, 0, codec->length);
+	}
+}
+
+/**
+ * Moves a codec's buffer over to another allocator
+ * Borrowed buffers stay where they are, only later growth uses allocator.
+ * returns: false if the new buffer couldn't be allocated
+ */
+bool codec_set_allocator(codec_t* codec, runite_allocator_t* allocator)
+{
+	if (allocator == codec->allocator) {
+		return true;
+	}
+	if (!codec->borrowed && codec->data != NULL) {
+		unsigned char* data = (unsigned char*)runite_alloc(allocator, codec->length);
+		if (data == NULL) {
+			return false;
+		}
+		memcpy(data, codec->data, codec->length);
+		runite_free(codec->allocator, codec->data, codec->length);
+		codec->data = data;
+	}
+	codec->allocator = allocator;
+	return true;
+}
+
+/**
+ * Enables or disables automatic growth. A growable codec reallocates
+ * rather than dropping puts which run past the end of the buffer.
+ */
+void codec_set_growable(codec_t* codec, bool growable)
+{
+	codec->growable = growable;
+}
+
+/**
+ * Ensures the buffer can hold at least capacity bytes
+ * Existing data is kept, new space is not initialized
+ * returns: Whether the buffer is large enough
+ */
+bool codec_reserve(codec_t* codec, size_t capacity)
+{
+	if (capacity <= codec->length) {
+		return true;
+	}
+	if (codec->read_only) {
+		return false;
+	}
+
+	unsigned char* data;
+	if (codec->borrowed) {
+		data = (unsigned char*)runite_alloc(codec->allocator, capacity);
+		if (data != NULL) {
+			memcpy(data, codec->data, codec->length);
+		}
+	} else {
+		data = (unsigned char*)runite_realloc(codec->allocator, codec->data, codec->length, capacity);
+	}
+	if (data == NULL) {
+		return false;
+	}
+	codec->data = data;
+	codec->length = capacity;
+	codec->borrowed = false;
+	return true;
+}
+
+/**
+ * Grows the buffer geometrically so that n bytes fit after the caret
+ * Called by codec_ensure, which should be preferred.
+ */
+bool codec_grow(codec_t* codec, size_t n)
+{
+	size_t capacity = max(codec->length*2, DEFAULT_BUFFER_SIZE);
+	return codec_reserve(codec, max(capacity, codec->caret+n));
+}
+
+/**
+ * Shrinks the buffer down to the valid data
+ */
+void codec_shrink(codec_t* codec)
+{
+	size_t len = codec_len(codec);
+	if (len == 0 || len == codec->length || codec->borrowed) {
+		return;
+	}
+	unsigned char* data = (unsigned char*)runite_realloc(codec->allocator, codec->data, codec->length, len);
+	if (data != NULL) {
+		codec->data = data;
+		codec->length = len;
+	}
 }
 
 /**
@@ -70,13 +262,12 @@ void codec_seek(codec_t* codec, size_t caret)
 }
 
 /**
- * Returns the amount of valid data in the codec
+ * Returns the amount of valid data in the codec: the furthest point
+ * written to, or the caret if that's further along
  */
 size_t codec_len(codec_t* codec)
 {
-	// We could do with a more reliable way to keep track of
-	// the valid data in the buffer.
-	return codec->caret;
+	return max(codec->size, codec->caret);
 }
 
 /**
@@ -99,39 +290,91 @@ void codec_set_bit_access_mode(codec_t* codec, bool bit_mode)
 	codec->bit_access_mode = bit_mode;
 }
 
+/**
+ * Loads the (up to) 8 bytes from the caret into a big endian accumulator
+ *  - nbytes: The number of bytes which are actually needed
+ */
+static uint64_t codec_load_bits(codec_t* codec, size_t nbytes)
+{
+	if (codec->caret+8 <= codec->length) {
+		return codec_load64(codec->data + codec->caret);
+	}
+	uint64_t word = 0;
+	for (size_t n = 0; n < nbytes; n++) {
+		word |= (uint64_t)codec->data[codec->caret+n] << (56 - n*8);
+	}
+	return word;
+}
+
+/**
+ * Advances the bit caret by nbits
+ */
+static void codec_skip_bits(codec_t* codec, int nbits)
+{
+	size_t bit_pos = codec->caret*8 + (7 - codec->bit_caret) + nbits;
+	codec->caret = bit_pos / 8;
+	codec->bit_caret = 7 - (bit_pos % 8);
+}
+
 /**
  * Puts a given number of bits to the codec
- *  - nbits: The number of bits to put
+ * Bits are packed MSB first, and the affected bytes are updated with a
+ * single 64 bit read-modify-write.
+ *  - nbits: The number of bits to put, at most 32
  *  - i: The value to put
  */
 void codec_put_bits(codec_t* codec, int nbits, uint32_t i)
 {
 	assert(codec->bit_access_mode);
-	for (int n = nbits-1; n >= 0; n--) {
-		uint8_t bit_val = (i & (1 << n)) >> n;
-		if (bit_val) {
-			codec->data[codec->caret] |= (1 << codec->bit_caret);
-		} else {
-			codec->data[codec->caret] &= ~(1 << codec->bit_caret);
-		}
-		if (codec->bit_caret == 0) {
-			codec->bit_caret = 7;
-			codec->caret++;
-		} else {
-			codec->bit_caret--;
+	assert(nbits <= 32);
+	if (nbits <= 0) {
+		return;
+	}
+
+	int bit_ofs = 7 - codec->bit_caret;
+	int end = bit_ofs + nbits;
+	size_t nbytes = (end + 7) / 8;
+	if (!codec_ensure(codec, nbytes)) {
+		return;
+	}
+
+	uint64_t mask = (((uint64_t)1 << nbits) - 1) << (64 - end);
+	uint64_t bits = ((uint64_t)i << (64 - end)) & mask;
+	uint64_t word = (codec_load_bits(codec, nbytes) & ~mask) | bits;
+
+	if (codec->caret+8 <= codec->length) {
+		codec_store64(codec->data + codec->caret, word);
+	} else {
+		for (size_t n = 0; n < nbytes; n++) {
+			codec->data[codec->caret+n] = word >> (56 - n*8);
 		}
 	}
+	codec_skip_bits(codec, nbits);
+	codec->size = max(codec->size, codec->caret + (codec->bit_caret != 7));
 }
 
 /**
  * Gets a given number of bits from the codec
- *  - nbits: The number of bits to get
+ *  - nbits: The number of bits to get, at most 32
  * returns: The value
  */
 uint32_t codec_get_bits(codec_t* codec, int nbits)
 {
-	/* todo */
-	return 0;
+	assert(codec->bit_access_mode);
+	assert(nbits <= 32);
+	if (nbits <= 0) {
+		return 0;
+	}
+
+	int bit_ofs = 7 - codec->bit_caret;
+	size_t nbytes = (bit_ofs + nbits + 7) / 8;
+	if (!codec_has(codec, nbytes)) {
+		return 0;
+	}
+
+	uint64_t word = codec_load_bits(codec, nbytes);
+	codec_skip_bits(codec, nbits);
+	return (word << bit_ofs) >> (64 - nbits);
 }
 
 /**
@@ -179,12 +422,13 @@ void codec_put64(codec_t* codec, uint64_t i)
  */
 void codec_putn(codec_t* codec, unsigned char* data, size_t len)
 {
-	if (codec->caret+len > codec->length || len == 0) {
+	if (len == 0 || !codec_ensure(codec, len)) {
 		return;
 	}
 
 	memcpy(&codec->data[codec->caret], data, len);
 	codec->caret += len;
+	codec_mark(codec);
 }
 
 /**
@@ -204,22 +448,18 @@ void codec_concat(codec_t* dest, codec_t* src)
  */
 void codec_put8f(codec_t* codec, uint8_t i, uint8_t flags)
 {
-	if (codec->caret+1 > codec->length) {
-		return;
-	}
-
-	uint8_t* val = (uint8_t*)&i;
-	if (flags & CODEC_NEGATIVE) {
-		val[0] = -val[0];
-	}
-	if (flags & CODEC_INV128) {
-		val[0] = 128 - val[0];
-	}
-	if (flags & CODEC_OFS128) {
-		val[0] = val[0] + 128;
+	switch (flags & CODEC_XFORM_MASK) {
+	case 0:
+		if (codec_ensure(codec, 1)) {
+			codec_put8_fast(codec, i);
+		}
+		break;
+	PUT_CASES(8, 0, )
+	default:
+		if (codec_ensure(codec, 1)) {
+			codec_put8_fast(codec, codec_xform_flags(i, flags));
+		}
 	}
-
-	codec->data[codec->caret++] = val[0];
 }
 
 /**
@@ -228,28 +468,20 @@ void codec_put8f(codec_t* codec, uint8_t i, uint8_t flags)
  */
 void codec_put16f(codec_t* codec, uint16_t i, uint8_t flags)
 {
-	if (codec->caret+2 > codec->length) {
-		return;
-	}
-
-	uint8_t* val = (uint8_t*)&i;
-	if (flags & CODEC_NEGATIVE) {
-		val[0] = -val[0];
-	}
-	if (flags & CODEC_INV128) {
-		val[0] = 128 - val[0];
-	}
-	if (flags & CODEC_OFS128) {
-		val[0] = val[0] + 128;
-	}
-	if (flags & CODEC_LITTLE) {
-		uint16_t tmp = i;
-		val[0] = ((unsigned char*)&tmp)[1];
-		val[1] = ((unsigned char*)&tmp)[0];
+	switch (flags & (CODEC_LITTLE | CODEC_XFORM_MASK)) {
+	case 0:
+		if (codec_ensure(codec, 2)) {
+			codec_put16_fast(codec, i);
+		}
+		break;
+	PUT_CASES(16, 0, )
+	PUT_ORDER_CASES(16, CODEC_LITTLE, _le)
+	default:
+		if (codec_ensure(codec, 2)) {
+			i = codec_xform_flags(i, flags);
+			codec_put16_fast(codec, flags & CODEC_LITTLE ? codec_order_le16(i) : i);
+		}
 	}
-
-	codec->data[codec->caret++] = val[1];
-	codec->data[codec->caret++] = val[0];
 }
 
 /**
@@ -259,31 +491,20 @@ void codec_put16f(codec_t* codec, uint16_t i, uint8_t flags)
  */
 void codec_put24f(codec_t* codec, uint32_t i, uint8_t flags)
 {
-	if (codec->caret+3 > codec->length) {
-		return;
-	}
-
-	uint8_t* val = (uint8_t*)&i;
-	val[3] = 0;
-	if (flags & CODEC_NEGATIVE) {
-		val[0] = -val[0];
-	}
-	if (flags & CODEC_INV128) {
-		val[0] = 128 - val[0];
-	}
-	if (flags & CODEC_OFS128) {
-		val[0] = val[0] + 128;
-	}
-	if (flags & CODEC_LITTLE) {
-		uint32_t tmp = i;
-		val[0] = ((unsigned char*)&tmp)[2];
-		val[1] = ((unsigned char*)&tmp)[1];
-		val[2] = ((unsigned char*)&tmp)[0];
+	switch (flags & (CODEC_LITTLE | CODEC_XFORM_MASK)) {
+	case 0:
+		if (codec_ensure(codec, 3)) {
+			codec_put24_fast(codec, i);
+		}
+		break;
+	PUT_CASES(24, 0, )
+	PUT_ORDER_CASES(24, CODEC_LITTLE, _le)
+	default:
+		if (codec_ensure(codec, 3)) {
+			i = codec_xform_flags(i, flags);
+			codec_put24_fast(codec, flags & CODEC_LITTLE ? codec_order_le24(i) : i);
+		}
 	}
-
-	codec->data[codec->caret++] = val[2];
-	codec->data[codec->caret++] = val[1];
-	codec->data[codec->caret++] = val[0];
 }
 
 /**
@@ -292,46 +513,22 @@ void codec_put24f(codec_t* codec, uint32_t i, uint8_t flags)
  */
 void codec_put32f(codec_t* codec, uint32_t i, uint8_t flags)
 {
-	if (codec->caret+4 > codec->length) {
-		return;
-	}
-
-	uint8_t* val = (uint8_t*)&i;
-	if (flags & CODEC_NEGATIVE) {
-		val[0] = -val[0];
-	}
-	if (flags & CODEC_INV128) {
-		val[0] = 128 - val[0];
-	}
-	if (flags & CODEC_OFS128) {
-		val[0] = val[0] + 128;
-	}
-	if (flags & CODEC_LITTLE) {
-		uint32_t tmp = i;
-		val[0] = ((unsigned char*)&tmp)[3];
-		val[1] = ((unsigned char*)&tmp)[2];
-		val[2] = ((unsigned char*)&tmp)[1];
-		val[3] = ((unsigned char*)&tmp)[0];
-	} else if (flags & CODEC_MIDDLE_A) {
-		/* This is essentially PDP-endian */
-		uint32_t tmp = i;
-		val[0] = ((unsigned char*)&tmp)[1];
-		val[1] = ((unsigned char*)&tmp)[0];
-		val[2] = ((unsigned char*)&tmp)[3];
-		val[3] = ((unsigned char*)&tmp)[2];
-	} else if (flags & CODEC_MIDDLE_B) {
-		/* The reverse of MIXED_A */
-		uint32_t tmp = i;
-		val[0] = ((unsigned char*)&tmp)[2];
-		val[1] = ((unsigned char*)&tmp)[3];
-		val[2] = ((unsigned char*)&tmp)[0];
-		val[3] = ((unsigned char*)&tmp)[1];
+	switch (flags & (CODEC_ORDER_MASK | CODEC_XFORM_MASK)) {
+	case 0:
+		if (codec_ensure(codec, 4)) {
+			codec_put32_fast(codec, i);
+		}
+		break;
+	PUT_CASES(32, 0, )
+	PUT_ORDER_CASES(32, CODEC_LITTLE, _le)
+	PUT_ORDER_CASES(32, CODEC_MIDDLE_A, _ma)
+	PUT_ORDER_CASES(32, CODEC_MIDDLE_B, _mb)
+	default:
+		if (codec_ensure(codec, 4)) {
+			i = codec_xform_flags(i, flags);
+			codec_put32_fast(codec, codec_order_flags32(i, flags));
+		}
 	}
-
-	codec->data[codec->caret++] = val[3];
-	codec->data[codec->caret++] = val[2];
-	codec->data[codec->caret++] = val[1];
-	codec->data[codec->caret++] = val[0];
 }
 
 /**
@@ -340,40 +537,20 @@ void codec_put32f(codec_t* codec, uint32_t i, uint8_t flags)
  */
 void codec_put64f(codec_t* codec, uint64_t i, uint8_t flags)
 {
-	if (codec->caret+8 > codec->length) {
-		return;
-	}
-
-	uint8_t* val = (uint8_t*)&i;
-	if (flags & CODEC_NEGATIVE) {
-		val[0] = -val[0];
-	}
-	if (flags & CODEC_INV128) {
-		val[0] = 128 - val[0];
-	}
-	if (flags & CODEC_OFS128) {
-		val[0] = val[0] + 128;
-	}
-	if (flags & CODEC_LITTLE) {
-		uint64_t tmp = i;
-		val[0] = ((unsigned char*)&tmp)[7];
-		val[1] = ((unsigned char*)&tmp)[6];
-		val[2] = ((unsigned char*)&tmp)[5];
-		val[3] = ((unsigned char*)&tmp)[4];
-		val[4] = ((unsigned char*)&tmp)[3];
-		val[5] = ((unsigned char*)&tmp)[2];
-		val[6] = ((unsigned char*)&tmp)[1];
-		val[7] = ((unsigned char*)&tmp)[0];
+	switch (flags & (CODEC_LITTLE | CODEC_XFORM_MASK)) {
+	case 0:
+		if (codec_ensure(codec, 8)) {
+			codec_put64_fast(codec, i);
+		}
+		break;
+	PUT_CASES(64, 0, )
+	PUT_ORDER_CASES(64, CODEC_LITTLE, _le)
+	default:
+		if (codec_ensure(codec, 8)) {
+			i = codec_xform_flags(i, flags);
+			codec_put64_fast(codec, flags & CODEC_LITTLE ? codec_order_le64(i) : i);
+		}
 	}
-
-	codec->data[codec->caret++] = val[7];
-	codec->data[codec->caret++] = val[6];
-	codec->data[codec->caret++] = val[5];
-	codec->data[codec->caret++] = val[4];
-	codec->data[codec->caret++] = val[3];
-	codec->data[codec->caret++] = val[2];
-	codec->data[codec->caret++] = val[1];
-	codec->data[codec->caret++] = val[0];
 }
 
 /**
@@ -382,7 +559,7 @@ void codec_put64f(codec_t* codec, uint64_t i, uint8_t flags)
  */
 void codec_puts(codec_t* codec, char* s, int len, uint8_t flags)
 {
-	if (codec->caret+len > codec->length) {
+	if (!codec_ensure(codec, len+1)) {
 		return;
 	}
 
@@ -465,28 +642,23 @@ unsigned char* codec_getn(codec_t* codec, unsigned char* data, size_t len)
  */
 uint8_t codec_get8fp(codec_t* codec, uint8_t* i, uint8_t flags)
 {
-	if (codec->caret+1 > codec->length) {
+	if (!codec_has(codec, 1)) {
 		return 0;
 	}
 
 	uint8_t x;
-	if (i == NULL) {
-		i = &x;
+	switch (flags & CODEC_XFORM_MASK) {
+	case 0:
+		x = codec_get8_fast(codec);
+		break;
+	GET_CASES(8, 0, )
+	default:
+		x = codec_xform_flags(codec_get8_fast(codec), flags);
 	}
-	uint8_t* val = (uint8_t*)i;
-
-	val[0] = codec->data[codec->caret++];
-
-	if (flags & CODEC_NEGATIVE) {
-		val[0] = -val[0];
-	}
-	if (flags & CODEC_INV128) {
-		val[0] = 128 - val[0];
+	if (i != NULL) {
+		*i = x;
 	}
-	if (flags & CODEC_OFS128) {
-		val[0] = val[0] - 128;
-	}
-	return *i;
+	return x;
 }
 
 /**
@@ -496,34 +668,25 @@ uint8_t codec_get8fp(codec_t* codec, uint8_t* i, uint8_t flags)
  */
 uint16_t codec_get16fp(codec_t* codec, uint16_t* i, uint8_t flags)
 {
-	if (codec->caret+2 > codec->length) {
+	if (!codec_has(codec, 2)) {
 		return 0;
 	}
 
 	uint16_t x;
-	if (i == NULL) {
-		i = &x;
-	}
-	uint8_t* val = (uint8_t*)i;
-
-	val[1] = codec->data[codec->caret++];
-	val[0] = codec->data[codec->caret++];
-
-	if (flags & CODEC_LITTLE) {
-		uint16_t tmp = *i;
-		val[0] = ((unsigned char*)&tmp)[1];
-		val[1] = ((unsigned char*)&tmp)[0];
-	}
-	if (flags & CODEC_NEGATIVE) {
-		val[0] = -val[0];
+	switch (flags & (CODEC_LITTLE | CODEC_XFORM_MASK)) {
+	case 0:
+		x = codec_get16_fast(codec);
+		break;
+	GET_CASES(16, 0, )
+	GET_ORDER_CASES(16, CODEC_LITTLE, _le)
+	default:
+		x = codec_get16_fast(codec);
+		x = codec_xform_flags(flags & CODEC_LITTLE ? codec_order_le16(x) : x, flags);
 	}
-	if (flags & CODEC_INV128) {
-		val[0] = 128 - val[0];
+	if (i != NULL) {
+		*i = x;
 	}
-	if (flags & CODEC_OFS128) {
-		val[0] = val[0] - 128;
-	}
-	return *i;
+	return x;
 }
 
 /**
@@ -533,37 +696,25 @@ uint16_t codec_get16fp(codec_t* codec, uint16_t* i, uint8_t flags)
  */
 uint32_t codec_get24fp(codec_t* codec, uint32_t* i, uint8_t flags)
 {
-	if (codec->caret+3 > codec->length) {
+	if (!codec_has(codec, 3)) {
 		return 0;
 	}
 
 	uint32_t x;
-	if (i == NULL) {
-		i = &x;
-	}
-	uint8_t* val = (uint8_t*)i;
-
-	val[3] = 0;
-	val[2] = codec->data[codec->caret++];
-	val[1] = codec->data[codec->caret++];
-	val[0] = codec->data[codec->caret++];
-
-	if (flags & CODEC_LITTLE) {
-		uint32_t tmp = *i;
-		val[0] = ((unsigned char*)&tmp)[2];
-		val[1] = ((unsigned char*)&tmp)[1];
-		val[2] = ((unsigned char*)&tmp)[0];
-	}
-	if (flags & CODEC_NEGATIVE) {
-		val[0] = -val[0];
+	switch (flags & (CODEC_LITTLE | CODEC_XFORM_MASK)) {
+	case 0:
+		x = codec_get24_fast(codec);
+		break;
+	GET_CASES(24, 0, )
+	GET_ORDER_CASES(24, CODEC_LITTLE, _le)
+	default:
+		x = codec_get24_fast(codec);
+		x = codec_xform_flags(flags & CODEC_LITTLE ? codec_order_le24(x) : x, flags);
 	}
-	if (flags & CODEC_INV128) {
-		val[0] = 128 - val[0];
+	if (i != NULL) {
+		*i = x;
 	}
-	if (flags & CODEC_OFS128) {
-		val[0] = val[0] - 128;
-	}
-	return *i;
+	return x;
 }
 
 /**
@@ -573,50 +724,26 @@ uint32_t codec_get24fp(codec_t* codec, uint32_t* i, uint8_t flags)
  */
 uint32_t codec_get32fp(codec_t* codec, uint32_t* i, uint8_t flags)
 {
-	if (codec->caret+4 > codec->length) {
+	if (!codec_has(codec, 4)) {
 		return 0;
 	}
 
 	uint32_t x;
-	if (i == NULL) {
-		i = &x;
-	}
-	uint8_t* val = (uint8_t*)i;
-
-	val[3] = codec->data[codec->caret++];
-	val[2] = codec->data[codec->caret++];
-	val[1] = codec->data[codec->caret++];
-	val[0] = codec->data[codec->caret++];
-
-	if (flags & CODEC_LITTLE) {
-		uint32_t tmp = *i;
-		val[0] = ((unsigned char*)&tmp)[3];
-		val[1] = ((unsigned char*)&tmp)[2];
-		val[2] = ((unsigned char*)&tmp)[1];
-		val[3] = ((unsigned char*)&tmp)[0];
-	} else if (flags & CODEC_MIDDLE_A) {
-		uint32_t tmp = *i;
-		val[0] = ((unsigned char*)&tmp)[1];
-		val[1] = ((unsigned char*)&tmp)[0];
-		val[2] = ((unsigned char*)&tmp)[3];
-		val[3] = ((unsigned char*)&tmp)[2];
-	} else if (flags & CODEC_MIDDLE_B) {
-		uint32_t tmp = *i;
-		val[0] = ((unsigned char*)&tmp)[2];
-		val[1] = ((unsigned char*)&tmp)[3];
-		val[2] = ((unsigned char*)&tmp)[0];
-		val[3] = ((unsigned char*)&tmp)[1];
-	}
-	if (flags & CODEC_NEGATIVE) {
-		val[0] = -val[0];
+	switch (flags & (CODEC_ORDER_MASK | CODEC_XFORM_MASK)) {
+	case 0:
+		x = codec_get32_fast(codec);
+		break;
+	GET_CASES(32, 0, )
+	GET_ORDER_CASES(32, CODEC_LITTLE, _le)
+	GET_ORDER_CASES(32, CODEC_MIDDLE_A, _ma)
+	GET_ORDER_CASES(32, CODEC_MIDDLE_B, _mb)
+	default:
+		x = codec_xform_flags(codec_order_flags32(codec_get32_fast(codec), flags), flags);
 	}
-	if (flags & CODEC_INV128) {
-		val[0] = 128 - val[0];
+	if (i != NULL) {
+		*i = x;
 	}
-	if (flags & CODEC_OFS128) {
-		val[0] = val[0] - 128;
-	}
-	return *i;
+	return x;
 }
 
 
@@ -627,46 +754,25 @@ uint32_t codec_get32fp(codec_t* codec, uint32_t* i, uint8_t flags)
  */
 uint64_t codec_get64fp(codec_t* codec, uint64_t* i, uint8_t flags)
 {
-	if (codec->caret+8 > codec->length) {
+	if (!codec_has(codec, 8)) {
 		return 0;
 	}
 
 	uint64_t x;
-	if (i == NULL) {
-		i = &x;
-	}
-	uint8_t* val = (uint8_t*)i;
-
-	val[7] = codec->data[codec->caret++];
-	val[6] = codec->data[codec->caret++];
-	val[5] = codec->data[codec->caret++];
-	val[4] = codec->data[codec->caret++];
-	val[3] = codec->data[codec->caret++];
-	val[2] = codec->data[codec->caret++];
-	val[1] = codec->data[codec->caret++];
-	val[0] = codec->data[codec->caret++];
-
-	if (flags & CODEC_LITTLE) {
-		uint64_t tmp = *i;
-		val[0] = ((unsigned char*)&tmp)[7];
-		val[1] = ((unsigned char*)&tmp)[6];
-		val[2] = ((unsigned char*)&tmp)[5];
-		val[3] = ((unsigned char*)&tmp)[4];
-		val[4] = ((unsigned char*)&tmp)[3];
-		val[5] = ((unsigned char*)&tmp)[2];
-		val[6] = ((unsigned char*)&tmp)[1];
-		val[7] = ((unsigned char*)&tmp)[0];
-	}
-	if (flags & CODEC_NEGATIVE) {
-		val[0] = -val[0];
+	switch (flags & (CODEC_LITTLE | CODEC_XFORM_MASK)) {
+	case 0:
+		x = codec_get64_fast(codec);
+		break;
+	GET_CASES(64, 0, )
+	GET_ORDER_CASES(64, CODEC_LITTLE, _le)
+	default:
+		x = codec_get64_fast(codec);
+		x = codec_xform_flags(flags & CODEC_LITTLE ? codec_order_le64(x) : x, flags);
 	}
-	if (flags & CODEC_INV128) {
-		val[0] = 128 - val[0];
+	if (i != NULL) {
+		*i = x;
 	}
-	if (flags & CODEC_OFS128) {
-		val[0] = val[0] - 128;
-	}
-	return *i;
+	return x;
 }
 
 /**
@@ -701,7 +807,10 @@ char* codec_gets(codec_t* codec, char* s, int len, uint8_t flags)
 	return s;
 }
 
+static object_slab_t codec_slab = OBJECT_SLAB_INITIALIZER;
+
 object_proto_t codec_proto = {
 	.init = (object_init_t)codec_init,
-	.free = (object_free_t)codec_free
+	.free = (object_free_t)codec_free,
+	.slab = &codec_slab
 };
@@ -0,0 +1,315 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * codec_array.c
+ *
+ * Bulk gets and puts of 16 and 32 bit values. Every byte order is a fixed
+ * permutation of the bytes within each value, and every combination of
+ * transforms is an affine map on the least significant byte, so a whole
+ * array is converted with one shuffle and one xor/add pass. Vector kernels
+ * are used where available and the scalar loop handles the rest.
+ */
+
+#include <runite/util/codec.h>
+#include <runite/util/codec_fast.h>
+#include <runite/util/codec_variants.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#include <immintrin.h>
+#define CODEC_ARRAY_SSE2
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CODEC_ARRAY_AVX2
+#endif
+#elif defined(__ARM_NEON) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#include <arm_neon.h>
+#define CODEC_ARRAY_NEON
+#endif
+
+/* position of the least significant byte of a value in host memory */
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define HOST_LOW(width) ((width)-1)
+#else
+#define HOST_LOW(width) 0
+#endif
+
+typedef struct codec_array_op codec_array_op_t;
+
+/**
+ * A conversion between codec bytes and host values
+ * Byte i of each value in the output is byte (i ^ swizzle) of the input,
+ * then the byte at low is replaced with (b ^ xor) + add.
+ */
+struct codec_array_op {
+	int width;
+	int swizzle;
+	int low;
+	uint8_t xor;
+	uint8_t add;
+};
+
+/**
+ * Works out the byte swizzle from codec memory to host memory
+ */
+static int codec_array_swizzle(int width, uint8_t flags)
+{
+	int swizzle;
+	if (width == 2) {
+		swizzle = flags & CODEC_LITTLE ? 0 : 1;
+	} else if (flags & CODEC_LITTLE) {
+		swizzle = 0;
+	} else if (flags & CODEC_MIDDLE_A) {
+		swizzle = 2;
+	} else if (flags & CODEC_MIDDLE_B) {
+		swizzle = 1;
+	} else {
+		swizzle = 3;
+	}
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	swizzle ^= width-1;
+#endif
+	return swizzle;
+}
+
+/**
+ * Builds the op for a get (get = true) or put of values of the given width
+ */
+static void codec_array_op(codec_array_op_t* op, int width, uint8_t flags, bool get)
+{
+	op->width = width;
+	op->swizzle = codec_array_swizzle(width, flags);
+	op->low = get ? HOST_LOW(width) : HOST_LOW(width) ^ op->swizzle;
+
+	/* the transforms compose to either b + k or k - b on the low byte */
+	uint8_t base = codec_xform_flags(0, flags);
+	uint8_t step = codec_xform_flags(1, flags) - base;
+	if (step == 1) {
+		op->xor = 0;
+		op->add = base;
+	} else {
+		op->xor = 0xff;
+		op->add = base + 1;
+	}
+}
+
+static void codec_array_scalar(const codec_array_op_t* op, unsigned char* dst, const unsigned char* src, size_t len)
+{
+	int width = op->width;
+	for (size_t i = 0; i < len; i += width) {
+		for (int j = 0; j < width; j++) {
+			dst[i+j] = src[i+(j^op->swizzle)];
+		}
+		dst[i+op->low] = (dst[i+op->low] ^ op->xor) + op->add;
+	}
+}
+
+/**
+ * Fills a 32 byte pattern with the xor and add masks for an op
+ */
+static void codec_array_masks(const codec_array_op_t* op, uint8_t* xor_mask, uint8_t* add_mask)
+{
+	for (int i = 0; i < 32; i++) {
+		bool low = (i % op->width) == op->low;
+		xor_mask[i] = low ? op->xor : 0;
+		add_mask[i] = low ? op->add : 0;
+	}
+}
+
+#ifdef CODEC_ARRAY_SSE2
+static size_t codec_array_sse2(const codec_array_op_t* op, unsigned char* dst, const unsigned char* src, size_t len)
+{
+	uint8_t xor_bytes[32], add_bytes[32];
+	codec_array_masks(op, xor_bytes, add_bytes);
+	__m128i xor_mask = _mm_loadu_si128((const __m128i*)xor_bytes);
+	__m128i add_mask = _mm_loadu_si128((const __m128i*)add_bytes);
+
+	size_t i;
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+		if (op->swizzle & 1) {
+			v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		}
+		if (op->swizzle & 2) {
+			v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+			v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+		}
+		v = _mm_add_epi8(_mm_xor_si128(v, xor_mask), add_mask);
+		_mm_storeu_si128((__m128i*)(dst + i), v);
+	}
+	return i;
+}
+#endif
+
+#ifdef CODEC_ARRAY_AVX2
+__attribute__((target("avx2")))
+static size_t codec_array_avx2(const codec_array_op_t* op, unsigned char* dst, const unsigned char* src, size_t len)
+{
+	uint8_t xor_bytes[32], add_bytes[32], shuffle_bytes[32];
+	codec_array_masks(op, xor_bytes, add_bytes);
+	for (int i = 0; i < 32; i++) {
+		/* the swizzle never leaves a 16 byte lane */
+		shuffle_bytes[i] = (i & 15) ^ op->swizzle;
+	}
+	__m256i xor_mask = _mm256_loadu_si256((const __m256i*)xor_bytes);
+	__m256i add_mask = _mm256_loadu_si256((const __m256i*)add_bytes);
+	__m256i shuffle = _mm256_loadu_si256((const __m256i*)shuffle_bytes);
+
+	size_t i;
+	for (i = 0; i + 32 <= len; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+		v = _mm256_shuffle_epi8(v, shuffle);
+		v = _mm256_add_epi8(_mm256_xor_si256(v, xor_mask), add_mask);
+		_mm256_storeu_si256((__m256i*)(dst + i), v);
+	}
+	return i;
+}
+#endif
+
+#ifdef CODEC_ARRAY_NEON
+static size_t codec_array_neon(const codec_array_op_t* op, unsigned char* dst, const unsigned char* src, size_t len)
+{
+	uint8_t xor_bytes[32], add_bytes[32];
+	codec_array_masks(op, xor_bytes, add_bytes);
+	uint8x16_t xor_mask = vld1q_u8(xor_bytes);
+	uint8x16_t add_mask = vld1q_u8(add_bytes);
+
+	size_t i;
+	for (i = 0; i + 16 <= len; i += 16) {
+		uint8x16_t v = vld1q_u8(src + i);
+		switch (op->swizzle) {
+		case 1:
+			v = vrev16q_u8(v);
+			break;
+		case 2:
+			v = vreinterpretq_u8_u16(vrev32q_u16(vreinterpretq_u16_u8(v)));
+			break;
+		case 3:
+			v = vrev32q_u8(v);
+			break;
+		}
+		v = vaddq_u8(veorq_u8(v, xor_mask), add_mask);
+		vst1q_u8(dst + i, v);
+	}
+	return i;
+}
+#endif
+
+/**
+ * Converts len bytes from src to dst, which must not overlap
+ */
+static void codec_array_convert(const codec_array_op_t* op, unsigned char* dst, const unsigned char* src, size_t len)
+{
+	size_t done = 0;
+	if (op->swizzle == 0 && op->xor == 0 && op->add == 0) {
+		memcpy(dst, src, len);
+		return;
+	}
+#ifdef CODEC_ARRAY_AVX2
+	if (__builtin_cpu_supports("avx2")) {
+		done = codec_array_avx2(op, dst, src, len);
+	}
+#endif
+#ifdef CODEC_ARRAY_SSE2
+	done += codec_array_sse2(op, dst + done, src + done, len - done);
+#endif
+#ifdef CODEC_ARRAY_NEON
+	done += codec_array_neon(op, dst + done, src + done, len - done);
+#endif
+	codec_array_scalar(op, dst + done, src + done, len - done);
+}
+
+/**
+ * Gets n values of the given width into out
+ */
+static bool codec_get_array(codec_t* codec, void* out, size_t n, int width, uint8_t flags)
+{
+	if (n > SIZE_MAX/width || !codec_has(codec, n*width)) {
+		return false;
+	}
+	codec_array_op_t op;
+	codec_array_op(&op, width, flags, true);
+	codec_array_convert(&op, (unsigned char*)out, codec->data + codec->caret, n*width);
+	codec->caret += n*width;
+	return true;
+}
+
+/**
+ * Puts n values of the given width from in
+ */
+static bool codec_put_array(codec_t* codec, const void* in, size_t n, int width, uint8_t flags)
+{
+	if (n == 0) {
+		return true;
+	}
+	if (n > SIZE_MAX/width || !codec_ensure(codec, n*width)) {
+		return false;
+	}
+	codec_array_op_t op;
+	codec_array_op(&op, width, flags, false);
+	codec_array_convert(&op, codec->data + codec->caret, (const unsigned char*)in, n*width);
+	codec->caret += n*width;
+	codec_mark(codec);
+	return true;
+}
+
+/**
+ * Gets n 16 bit values from the codec, the same as n calls to codec_get16fp
+ *  - out: Location to store the values
+ *  - flags: Modifier flags
+ * returns: Whether there were n values to get. If not, nothing is read.
+ */
+bool codec_get16_array(codec_t* codec, uint16_t* out, size_t n, uint8_t flags)
+{
+	return codec_get_array(codec, out, n, 2, flags);
+}
+
+/**
+ * Gets n 32 bit values from the codec, the same as n calls to codec_get32fp
+ *  - out: Location to store the values
+ *  - flags: Modifier flags
+ * returns: Whether there were n values to get. If not, nothing is read.
+ */
+bool codec_get32_array(codec_t* codec, uint32_t* out, size_t n, uint8_t flags)
+{
+	return codec_get_array(codec, out, n, 4, flags);
+}
+
+/**
+ * Puts n 16 bit values to the codec, the same as n calls to codec_put16f
+ *  - in: The values to put
+ *  - flags: Modifier flags
+ * returns: Whether there was room. If not, nothing is written.
+ */
+bool codec_put16_array(codec_t* codec, const uint16_t* in, size_t n, uint8_t flags)
+{
+	return codec_put_array(codec, in, n, 2, flags);
+}
+
+/**
+ * Puts n 32 bit values to the codec, the same as n calls to codec_put32f
+ *  - in: The values to put
+ *  - flags: Modifier flags
+ * returns: Whether there was room. If not, nothing is written.
+ */
+bool codec_put32_array(codec_t* codec, const uint32_t* in, size_t n, uint8_t flags)
+{
+	return codec_put_array(codec, in, n, 4, flags);
+}
@@ -0,0 +1,279 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * codec_chain.c
+ *
+ * Scatter-gather output. Partial writes are tracked as a segment index
+ * plus an offset into that segment, so a chain can be flushed over
+ * several calls on a non-blocking socket.
+ */
+
+#include <runite/util/codec_chain.h>
+
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+#define CHAIN_INITIAL_CAPACITY 16
+
+/**
+ * Initializes a new codec chain
+ */
+static void codec_chain_init(codec_chain_t* chain)
+{
+	chain->iov = NULL;
+	chain->owned = NULL;
+	chain->shared = NULL;
+	chain->num_segments = 0;
+	chain->capacity = 0;
+	chain->head = 0;
+	chain->head_ofs = 0;
+	chain->remaining = 0;
+}
+
+/**
+ * Properly frees a codec chain, along with any unsent owned codecs and
+ * shared file references
+ */
+static void codec_chain_free(codec_chain_t* chain)
+{
+	codec_chain_reset(chain);
+	free(chain->iov);
+	free(chain->owned);
+	free(chain->shared);
+}
+
+/**
+ * Frees the owned codecs and drops the shared files of segments [from, to)
+ */
+static void codec_chain_release(codec_chain_t* chain, size_t from, size_t to)
+{
+	for (size_t i = from; i < to; i++) {
+		if (chain->owned[i] != NULL) {
+			object_free(chain->owned[i]);
+			chain->owned[i] = NULL;
+		}
+		if (chain->shared[i] != NULL) {
+			file_buffer_release(chain->shared[i]);
+			chain->shared[i] = NULL;
+		}
+	}
+}
+
+/**
+ * Drops every segment, freeing owned codecs and shared file references
+ * whether or not they were sent
+ */
+void codec_chain_reset(codec_chain_t* chain)
+{
+	codec_chain_release(chain, chain->head, chain->num_segments);
+	chain->num_segments = 0;
+	chain->head = 0;
+	chain->head_ofs = 0;
+	chain->remaining = 0;
+}
+
+/**
+ * Appends a segment to the chain
+ *  - owned: A codec to free once the segment is sent, or NULL
+ *  - shared: A buffer reference to drop once the segment is sent, or NULL
+ */
+static bool codec_chain_push(codec_chain_t* chain, void* data, size_t len, codec_t* owned, file_buffer_t* shared)
+{
+	if (chain->head == chain->num_segments) {
+		/* everything so far has been sent, start again from the front */
+		chain->num_segments = chain->head = chain->head_ofs = 0;
+	}
+	if (chain->num_segments == chain->capacity) {
+		size_t capacity = chain->capacity ? chain->capacity*2 : CHAIN_INITIAL_CAPACITY;
+		struct iovec* iov = (struct iovec*)realloc(chain->iov, capacity*sizeof(struct iovec));
+		if (iov == NULL) {
+			return false;
+		}
+		chain->iov = iov;
+		codec_t** owned_list = (codec_t**)realloc(chain->owned, capacity*sizeof(codec_t*));
+		if (owned_list == NULL) {
+			return false;
+		}
+		chain->owned = owned_list;
+		file_buffer_t** shared_list = (file_buffer_t**)realloc(chain->shared, capacity*sizeof(file_buffer_t*));
+		if (shared_list == NULL) {
+			return false;
+		}
+		chain->shared = shared_list;
+		chain->capacity = capacity;
+	}
+
+	chain->iov[chain->num_segments].iov_base = data;
+	chain->iov[chain->num_segments].iov_len = len;
+	chain->owned[chain->num_segments] = owned;
+	chain->shared[chain->num_segments] = shared;
+	chain->num_segments++;
+	chain->remaining += len;
+	return true;
+}
+
+/**
+ * Appends a codec's valid data (codec_len bytes) to the chain
+ *  - owned: Whether the chain takes the codec and frees it once sent
+ * returns: false if the segment couldn't be added, in which case an
+ *          owned codec is still the caller's
+ */
+bool codec_chain_add_codec(codec_chain_t* chain, codec_t* codec, bool owned)
+{
+	return codec_chain_push(chain, codec->data, codec_len(codec), owned ? codec : NULL, NULL);
+}
+
+/**
+ * Appends borrowed memory to the chain
+ * The memory must stay valid until it has been sent or the chain is reset.
+ */
+bool codec_chain_add_buffer(codec_chain_t* chain, const void* data, size_t len)
+{
+	return codec_chain_push(chain, (void*)data, len, NULL, NULL);
+}
+
+/**
+ * Appends a file to the chain. A file within a buffer (see file_share) is
+ * referenced until it has been sent, so the caller may free it straight
+ * away; any other file is borrowed, see codec_chain_add_buffer.
+ */
+bool codec_chain_add_file(codec_chain_t* chain, file_t* file)
+{
+	if (!(file->flags & (FILE_SHARED | FILE_BORROWED)) || file->buffer == NULL) {
+		return codec_chain_add_buffer(chain, file->data, file->length);
+	}
+	file_buffer_t* shared = file_buffer_acquire(file->buffer);
+	if (!codec_chain_push(chain, file->data, file->length, NULL, shared)) {
+		file_buffer_release(shared);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Gets the number of bytes left to send
+ */
+size_t codec_chain_len(codec_chain_t* chain)
+{
+	return chain->remaining;
+}
+
+/**
+ * Moves the chain forward by n sent bytes, freeing finished owned codecs
+ */
+static void codec_chain_advance(codec_chain_t* chain, size_t n)
+{
+	size_t first = chain->head;
+	chain->remaining -= n;
+	n += chain->head_ofs;
+	while (chain->head < chain->num_segments && n >= chain->iov[chain->head].iov_len) {
+		n -= chain->iov[chain->head].iov_len;
+		chain->head++;
+	}
+	chain->head_ofs = n;
+	codec_chain_release(chain, first, chain->head);
+}
+
+/**
+ * Flushes as much of the chain as fd will take, IOV_MAX segments per call
+ *  - use_send: Use sendmsg with flags rather than writev
+ * returns: The number of bytes sent, or -1 if nothing could be sent (errno
+ *          is set, EAGAIN for a full non-blocking socket)
+ */
+static ssize_t codec_chain_flush(codec_chain_t* chain, int fd, bool use_send, int flags)
+{
+	ssize_t total = 0;
+
+	while (chain->remaining > 0) {
+		/* skip empty segments so the head never points at one */
+		while (chain->iov[chain->head].iov_len == chain->head_ofs) {
+			codec_chain_advance(chain, 0);
+		}
+
+		struct iovec* iov = &chain->iov[chain->head];
+		size_t count = chain->num_segments - chain->head;
+		if (count > IOV_MAX) {
+			count = IOV_MAX;
+		}
+		size_t batch = 0;
+		for (size_t i = 0; i < count; i++) {
+			batch += iov[i].iov_len;
+		}
+		batch -= chain->head_ofs;
+
+		/* the first segment may be partly sent, offset it for this call only */
+		struct iovec first = iov[0];
+		iov[0].iov_base = (unsigned char*)iov[0].iov_base + chain->head_ofs;
+		iov[0].iov_len -= chain->head_ofs;
+
+		ssize_t written;
+		if (use_send) {
+			struct msghdr msg;
+			memset(&msg, 0, sizeof(msg));
+			msg.msg_iov = iov;
+			msg.msg_iovlen = count;
+			written = sendmsg(fd, &msg, flags);
+		} else {
+			written = writev(fd, iov, count);
+		}
+		iov[0] = first;
+
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return total > 0 ? total : -1;
+		}
+		codec_chain_advance(chain, written);
+		total += written;
+		if ((size_t)written < batch) {
+			break;
+		}
+	}
+	return total;
+}
+
+/**
+ * Writes the chain to a file descriptor with writev
+ * See codec_chain_flush for the return value
+ */
+ssize_t codec_chain_write(codec_chain_t* chain, int fd)
+{
+	return codec_chain_flush(chain, fd, false, 0);
+}
+
+/**
+ * Sends the chain over a socket with sendmsg
+ *  - flags: Flags for sendmsg, eg. MSG_NOSIGNAL
+ * See codec_chain_flush for the return value
+ */
+ssize_t codec_chain_send(codec_chain_t* chain, int fd, int flags)
+{
+	return codec_chain_flush(chain, fd, true, flags);
+}
+
+object_proto_t codec_chain_proto = {
+	.init = (object_init_t)codec_chain_init,
+	.free = (object_free_t)codec_chain_free
+};
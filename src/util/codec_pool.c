@@ -0,0 +1,316 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * codec_pool.c
+ *
+ * Size classed codec recycling with per thread caches. A thread's cache
+ * is created on its first acquire or release and handed back to the pool
+ * when the thread exits. Pooled codecs are growable and, unlike
+ * object_new(codec), their buffers are not zeroed between uses.
+ */
+
+#include <runite/util/codec_pool.h>
+
+#include <runite/util/container_of.h>
+
+#define CLASS_SIZE(size_class) ((size_t)DEFAULT_BUFFER_SIZE << (size_class))
+
+static void codec_pool_cache_flush(codec_pool_cache_t* cache);
+static void codec_pool_cache_release(void* cache);
+
+/**
+ * Initializes a new codec pool
+ */
+static void codec_pool_init(codec_pool_t* pool)
+{
+	pthread_key_create(&pool->cache_key, codec_pool_cache_release);
+	pthread_mutex_init(&pool->lock, NULL);
+	object_init(list, &pool->caches);
+	for (int i = 0; i < CODEC_POOL_NUM_CLASSES; i++) {
+		pool->free[i] = NULL;
+	}
+	memset(&pool->stats, 0, sizeof(pool->stats));
+}
+
+/**
+ * Frees a pooled codec for good
+ */
+static void codec_pool_entry_free(codec_pool_entry_t* entry)
+{
+	object_free(&entry->codec);
+	free(entry);
+}
+
+static void codec_pool_free_chain(codec_pool_entry_t* entry)
+{
+	while (entry != NULL) {
+		codec_pool_entry_t* next = entry->next;
+		codec_pool_entry_free(entry);
+		entry = next;
+	}
+}
+
+/**
+ * Properly frees a codec pool and every cached codec. Codecs which are
+ * still acquired must not be released afterwards, and no thread may use
+ * the pool once this begins.
+ */
+static void codec_pool_free(codec_pool_t* pool)
+{
+	pthread_key_delete(pool->cache_key);
+	while (!list_empty(&pool->caches)) {
+		codec_pool_cache_t* cache = container_of(list_front(&pool->caches), codec_pool_cache_t, node);
+		list_erase(&pool->caches, &cache->node);
+		for (int i = 0; i < CODEC_POOL_NUM_CLASSES; i++) {
+			codec_pool_free_chain(cache->free[i]);
+		}
+		free(cache);
+	}
+	for (int i = 0; i < CODEC_POOL_NUM_CLASSES; i++) {
+		codec_pool_free_chain(pool->free[i]);
+	}
+	object_free(&pool->caches);
+	pthread_mutex_destroy(&pool->lock);
+}
+
+/**
+ * Finds the smallest class which holds at least capacity bytes
+ * returns: The class, or -1 if capacity is too large to pool
+ */
+static int codec_pool_class_for(size_t capacity)
+{
+	for (int i = 0; i < CODEC_POOL_NUM_CLASSES; i++) {
+		if (capacity <= CLASS_SIZE(i)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Finds the largest class a buffer of the given size can serve
+ * returns: The class, or -1 if the buffer shouldn't be kept
+ */
+static int codec_pool_class_of(size_t length)
+{
+	for (int i = CODEC_POOL_NUM_CLASSES-1; i >= 0; i--) {
+		if (length >= CLASS_SIZE(i)) {
+			return length <= CLASS_SIZE(CODEC_POOL_NUM_CLASSES-1) ? i : -1;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Gets the calling thread's cache, creating it if needed
+ */
+static codec_pool_cache_t* codec_pool_local(codec_pool_t* pool)
+{
+	codec_pool_cache_t* cache = (codec_pool_cache_t*)pthread_getspecific(pool->cache_key);
+	if (cache != NULL) {
+		return cache;
+	}
+
+	cache = (codec_pool_cache_t*)calloc(1, sizeof(codec_pool_cache_t));
+	if (cache == NULL) {
+		return NULL;
+	}
+	cache->pool = pool;
+	pthread_mutex_lock(&pool->lock);
+	list_push_back(&pool->caches, &cache->node);
+	pthread_mutex_unlock(&pool->lock);
+	pthread_setspecific(pool->cache_key, cache);
+	return cache;
+}
+
+/**
+ * Moves every codec in a cache to the pool's shared lists
+ * The pool's lock must be held.
+ */
+static void codec_pool_cache_flush(codec_pool_cache_t* cache)
+{
+	codec_pool_t* pool = cache->pool;
+	for (int i = 0; i < CODEC_POOL_NUM_CLASSES; i++) {
+		while (cache->free[i] != NULL) {
+			codec_pool_entry_t* entry = cache->free[i];
+			cache->free[i] = entry->next;
+			entry->next = pool->free[i];
+			pool->free[i] = entry;
+		}
+		cache->count[i] = 0;
+	}
+}
+
+/**
+ * Thread exit destructor, gives the thread's cache back to the pool
+ */
+static void codec_pool_cache_release(void* ptr)
+{
+	codec_pool_cache_t* cache = (codec_pool_cache_t*)ptr;
+	codec_pool_t* pool = cache->pool;
+	pthread_mutex_lock(&pool->lock);
+	codec_pool_cache_flush(cache);
+	list_erase(&pool->caches, &cache->node);
+	pthread_mutex_unlock(&pool->lock);
+	free(cache);
+}
+
+/**
+ * Refills half of a cache's class from the pool's shared list
+ */
+static void codec_pool_cache_refill(codec_pool_cache_t* cache, int size_class)
+{
+	codec_pool_t* pool = cache->pool;
+	pthread_mutex_lock(&pool->lock);
+	while (cache->count[size_class] < CODEC_POOL_CACHE_SIZE/2 && pool->free[size_class] != NULL) {
+		codec_pool_entry_t* entry = pool->free[size_class];
+		pool->free[size_class] = entry->next;
+		entry->next = cache->free[size_class];
+		cache->free[size_class] = entry;
+		cache->count[size_class]++;
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Returns half of a full cache class to the pool's shared list
+ */
+static void codec_pool_cache_spill(codec_pool_cache_t* cache, int size_class)
+{
+	codec_pool_t* pool = cache->pool;
+	pthread_mutex_lock(&pool->lock);
+	while (cache->count[size_class] > CODEC_POOL_CACHE_SIZE/2) {
+		codec_pool_entry_t* entry = cache->free[size_class];
+		cache->free[size_class] = entry->next;
+		entry->next = pool->free[size_class];
+		pool->free[size_class] = entry;
+		cache->count[size_class]--;
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Allocates a new pooled codec with at least capacity bytes
+ */
+static codec_pool_entry_t* codec_pool_entry_new(size_t capacity)
+{
+	codec_pool_entry_t* entry = (codec_pool_entry_t*)malloc(sizeof(codec_pool_entry_t));
+	if (entry == NULL) {
+		return NULL;
+	}
+	object_init(codec, &entry->codec);
+	if (!codec_reserve(&entry->codec, capacity)) {
+		codec_pool_entry_free(entry);
+		return NULL;
+	}
+	entry->next = NULL;
+	return entry;
+}
+
+static void codec_pool_stat_max(size_t* high_water, size_t value)
+{
+	size_t cur = __atomic_load_n(high_water, __ATOMIC_RELAXED);
+	while (value > cur && !__atomic_compare_exchange_n(high_water, &cur, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/**
+ * Takes an empty, growable codec from the pool
+ *  - capacity: The minimum buffer size wanted, 0 for the smallest class
+ * returns: The codec, or NULL if allocation failed
+ */
+codec_t* codec_pool_acquire(codec_pool_t* pool, size_t capacity)
+{
+	codec_pool_entry_t* entry = NULL;
+	int size_class = codec_pool_class_for(capacity);
+	if (size_class >= 0) {
+		codec_pool_cache_t* cache = codec_pool_local(pool);
+		if (cache != NULL && cache->free[size_class] == NULL) {
+			codec_pool_cache_refill(cache, size_class);
+		}
+		if (cache != NULL && cache->free[size_class] != NULL) {
+			entry = cache->free[size_class];
+			cache->free[size_class] = entry->next;
+			cache->count[size_class]--;
+		}
+	}
+	if (entry == NULL) {
+		entry = codec_pool_entry_new(size_class >= 0 ? CLASS_SIZE(size_class) : capacity);
+		if (entry == NULL) {
+			return NULL;
+		}
+		__atomic_add_fetch(&pool->stats.allocations, 1, __ATOMIC_RELAXED);
+	}
+
+	codec_t* codec = &entry->codec;
+	codec->caret = 0;
+	codec->size = 0;
+	codec->bit_access_mode = false;
+	codec->bit_caret = 0;
+	codec->growable = true;
+	codec->overflow = false;
+	entry->next = NULL;
+	entry->charged = codec->length;
+
+	__atomic_add_fetch(&pool->stats.acquires, 1, __ATOMIC_RELAXED);
+	codec_pool_stat_max(&pool->stats.in_use_high_water, __atomic_add_fetch(&pool->stats.in_use, 1, __ATOMIC_RELAXED));
+	codec_pool_stat_max(&pool->stats.bytes_high_water, __atomic_add_fetch(&pool->stats.bytes_in_use, entry->charged, __ATOMIC_RELAXED));
+	return codec;
+}
+
+/**
+ * Gives a codec back to the pool
+ * The codec may have grown or been resized since it was acquired; it is
+ * filed under whichever class its buffer now fits, or freed.
+ */
+void codec_pool_release(codec_pool_t* pool, codec_t* codec)
+{
+	codec_pool_entry_t* entry = container_of(codec, codec_pool_entry_t, codec);
+	__atomic_sub_fetch(&pool->stats.in_use, 1, __ATOMIC_RELAXED);
+	__atomic_sub_fetch(&pool->stats.bytes_in_use, entry->charged, __ATOMIC_RELAXED);
+
+	int size_class = codec->borrowed || codec->read_only ? -1 : codec_pool_class_of(codec->length);
+	codec_pool_cache_t* cache = size_class >= 0 ? codec_pool_local(pool) : NULL;
+	if (cache == NULL) {
+		codec_pool_entry_free(entry);
+		return;
+	}
+
+	entry->next = cache->free[size_class];
+	cache->free[size_class] = entry;
+	if (++cache->count[size_class] > CODEC_POOL_CACHE_SIZE) {
+		codec_pool_cache_spill(cache, size_class);
+	}
+}
+
+/**
+ * Takes a snapshot of the pool's usage counters
+ */
+void codec_pool_get_stats(codec_pool_t* pool, codec_pool_stats_t* stats)
+{
+	stats->in_use = __atomic_load_n(&pool->stats.in_use, __ATOMIC_RELAXED);
+	stats->in_use_high_water = __atomic_load_n(&pool->stats.in_use_high_water, __ATOMIC_RELAXED);
+	stats->bytes_in_use = __atomic_load_n(&pool->stats.bytes_in_use, __ATOMIC_RELAXED);
+	stats->bytes_high_water = __atomic_load_n(&pool->stats.bytes_high_water, __ATOMIC_RELAXED);
+	stats->acquires = __atomic_load_n(&pool->stats.acquires, __ATOMIC_RELAXED);
+	stats->allocations = __atomic_load_n(&pool->stats.allocations, __ATOMIC_RELAXED);
+}
+
+object_proto_t codec_pool_proto = {
+	.init = (object_init_t)codec_pool_init,
+	.free = (object_free_t)codec_pool_free
+};
@@ -0,0 +1,186 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * codec_smart.c
+ *
+ * Variable length "smart" integers. The top bit of the first byte selects
+ * between the short and long form:
+ *  - smart: 1 byte 0..127, or 2 bytes 0..32767
+ *  - signed smart: 1 byte -64..63, or 2 bytes -16384..16383
+ *  - big smart: 2 bytes 0..32767, or 4 bytes 0..2^31-1
+ * Like the rest of the codec, out of bounds gets return 0 and leave the
+ * caret alone, and out of bounds puts are dropped.
+ */
+
+#include <runite/util/codec.h>
+#include <runite/util/codec_fast.h>
+
+#include <stdint.h>
+
+/**
+ * Checks whether the value at the caret uses the long form
+ */
+static inline bool codec_smart_wide(codec_t* codec)
+{
+	return codec->data[codec->caret] & 0x80;
+}
+
+/**
+ * Puts an unsigned smart to the codec
+ *  - i: The value, 0 to 32767
+ */
+void codec_put_smart(codec_t* codec, uint16_t i)
+{
+	if (i < 128) {
+		codec_put8(codec, i);
+	} else {
+		codec_put16(codec, i + 32768);
+	}
+}
+
+/**
+ * Puts a signed smart to the codec
+ *  - i: The value, -16384 to 16383
+ */
+void codec_put_signed_smart(codec_t* codec, int16_t i)
+{
+	if (i >= -64 && i < 64) {
+		codec_put8(codec, i + 64);
+	} else {
+		codec_put16(codec, i + 49152);
+	}
+}
+
+/**
+ * Puts a big smart to the codec
+ *  - i: The value, 0 to 2^31-1
+ */
+void codec_put_big_smart(codec_t* codec, uint32_t i)
+{
+	if (i < 32768) {
+		codec_put16(codec, i);
+	} else {
+		codec_put32(codec, i | 0x80000000);
+	}
+}
+
+/**
+ * Gets an unsigned smart from the codec
+ */
+uint16_t codec_get_smart(codec_t* codec)
+{
+	if (!codec_has(codec, 1)) {
+		return 0;
+	}
+	if (!codec_smart_wide(codec)) {
+		return codec_get8_fast(codec);
+	}
+	if (!codec_has(codec, 2)) {
+		return 0;
+	}
+	return codec_get16_fast(codec) - 32768;
+}
+
+/**
+ * Gets a signed smart from the codec
+ */
+int16_t codec_get_signed_smart(codec_t* codec)
+{
+	if (!codec_has(codec, 1)) {
+		return 0;
+	}
+	if (!codec_smart_wide(codec)) {
+		return codec_get8_fast(codec) - 64;
+	}
+	if (!codec_has(codec, 2)) {
+		return 0;
+	}
+	return codec_get16_fast(codec) - 49152;
+}
+
+/**
+ * Gets a big smart from the codec
+ */
+uint32_t codec_get_big_smart(codec_t* codec)
+{
+	if (!codec_has(codec, 1)) {
+		return 0;
+	}
+	if (!codec_smart_wide(codec)) {
+		return codec_has(codec, 2) ? codec_get16_fast(codec) : 0;
+	}
+	if (!codec_has(codec, 4)) {
+		return 0;
+	}
+	return codec_get32_fast(codec) & 0x7fffffff;
+}
+
+/**
+ * Decodes a run of smarts. While two bytes are left there is no bounds
+ * check per value and the short/long choice is a select rather than a
+ * branch, since the two forms are mixed unpredictably in real data.
+ *  - bias_short, bias_long: Subtracted from the short and long forms
+ */
+static bool codec_get_smarts(codec_t* codec, int32_t* out, size_t n, int32_t bias_short, int32_t bias_long)
+{
+	const unsigned char* start = codec->data + codec->caret;
+	const unsigned char* end = codec->data + codec->length;
+	const unsigned char* p = start;
+	size_t i = 0;
+
+	if (codec->caret > codec->length) {
+		return false;
+	}
+	for (; i < n && end - p >= 2; i++) {
+		uint32_t b0 = p[0];
+		uint32_t wide = b0 >> 7;
+		int32_t v_short = (int32_t)b0 - bias_short;
+		int32_t v_long = (int32_t)((b0 << 8) | p[1]) - bias_long;
+		out[i] = wide ? v_long : v_short;
+		p += 1 + wide;
+	}
+	for (; i < n; i++) {
+		if (p == end || (p[0] & 0x80)) {
+			return false;
+		}
+		out[i] = (int32_t)p[0] - bias_short;
+		p++;
+	}
+	codec->caret += p - start;
+	return true;
+}
+
+/**
+ * Gets n unsigned smarts from the codec
+ *  - out: Location to store the values
+ * returns: Whether there were n values to get. If not, nothing is read.
+ */
+bool codec_get_smart_array(codec_t* codec, int32_t* out, size_t n)
+{
+	return codec_get_smarts(codec, out, n, 0, 32768);
+}
+
+/**
+ * Gets n signed smarts from the codec
+ *  - out: Location to store the values
+ * returns: Whether there were n values to get. If not, nothing is read.
+ */
+bool codec_get_signed_smart_array(codec_t* codec, int32_t* out, size_t n)
+{
+	return codec_get_smarts(codec, out, n, 64, 49152);
+}
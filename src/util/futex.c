@@ -0,0 +1,150 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * futex.c
+ *
+ * Linux futexes, with a short sleep loop elsewhere
+ */
+
+#include <runite/util/futex.h>
+
+#include <errno.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define FUTEX_POLL_NS (100*1000)
+
+/**
+ * Initializes an event
+ */
+void futex_event_init(futex_event_t* event)
+{
+	event->seq = 0;
+	event->waiters = 0;
+}
+
+/**
+ * Registers the caller as a waiter and snapshots the sequence
+ * The caller must re-check its condition before futex_event_wait, and
+ * call futex_event_cancel instead if it no longer needs to wait.
+ */
+uint32_t futex_event_prepare(futex_event_t* event)
+{
+	__atomic_add_fetch(&event->waiters, 1, __ATOMIC_SEQ_CST);
+	/* pairs with the fence in futex_event_signal */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	return __atomic_load_n(&event->seq, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * Drops a registration made with futex_event_prepare without waiting
+ */
+void futex_event_cancel(futex_event_t* event)
+{
+	__atomic_sub_fetch(&event->waiters, 1, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * Sleeps until the event is signalled after seq was read
+ *  - seq: From futex_event_prepare
+ *  - timeout_ms: Longest time to sleep, or -1 for no limit
+ * returns: false if the timeout passed. Wakeups may be spurious.
+ */
+bool futex_event_wait(futex_event_t* event, uint32_t seq, int timeout_ms)
+{
+	struct timespec timeout;
+	timeout.tv_sec = timeout_ms / 1000;
+	timeout.tv_nsec = (long)(timeout_ms % 1000) * 1000000;
+	bool woken = true;
+
+#ifdef __linux__
+	if (syscall(SYS_futex, &event->seq, FUTEX_WAIT_PRIVATE, seq, timeout_ms < 0 ? NULL : &timeout, NULL, 0) != 0) {
+		woken = errno != ETIMEDOUT;
+	}
+#else
+	struct timespec poll = { 0, FUTEX_POLL_NS };
+	long waited_ns = 0;
+	while (__atomic_load_n(&event->seq, __ATOMIC_SEQ_CST) == seq) {
+		if (timeout_ms >= 0 && waited_ns >= (long)timeout_ms * 1000000) {
+			woken = false;
+			break;
+		}
+		nanosleep(&poll, NULL);
+		waited_ns += FUTEX_POLL_NS;
+	}
+#endif
+
+	__atomic_sub_fetch(&event->waiters, 1, __ATOMIC_SEQ_CST);
+	return woken;
+}
+
+/**
+ * Wakes every waiter. The sequence is left alone if nobody is waiting.
+ * Call after publishing whatever the waiters are waiting for: either a
+ * waiter's re-check sees it, or this sees the waiter.
+ */
+void futex_event_signal(futex_event_t* event)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&event->waiters, __ATOMIC_SEQ_CST) == 0) {
+		return;
+	}
+	__atomic_add_fetch(&event->seq, 1, __ATOMIC_SEQ_CST);
+#ifdef __linux__
+	syscall(SYS_futex, &event->seq, FUTEX_WAKE_PRIVATE, INT32_MAX, NULL, NULL, 0);
+#endif
+}
+
+/**
+ * Turns a relative timeout into a deadline for futex_remaining
+ *  - timeout_ms: The timeout, or -1 for no limit
+ */
+int64_t futex_deadline(int timeout_ms)
+{
+	if (timeout_ms < 0) {
+		return -1;
+	}
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec*1000000000 + now.tv_nsec + (int64_t)timeout_ms*1000000;
+}
+
+/**
+ * Works out how long is left until a deadline, for futex_event_wait
+ *  - deadline: From futex_deadline
+ * returns: The time left in milliseconds rounded up, 0 once the deadline
+ *          has passed, or -1 for no limit
+ */
+int futex_remaining(int64_t deadline)
+{
+	if (deadline < 0) {
+		return -1;
+	}
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	int64_t left = deadline - ((int64_t)now.tv_sec*1000000000 + now.tv_nsec);
+	if (left <= 0) {
+		return 0;
+	}
+	return (int)((left + 999999) / 1000000);
+}
@@ -0,0 +1,166 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * isaac.c
+ *
+ * Bob Jenkins' ISAAC, seeded the same way as the client (randinit with
+ * the seed words as the initial results).
+ */
+
+#include <runite/util/isaac.h>
+
+#include <string.h>
+
+#include <runite/util/codec_fast.h>
+
+#define GOLDEN_RATIO 0x9e3779b9
+
+#define ISAAC_MIX(a, b, c, d, e, f, g, h)	\
+	do {									\
+		a ^= b << 11; d += a; b += c;		\
+		b ^= c >> 2;  e += b; c += d;		\
+		c ^= d << 8;  f += c; d += e;		\
+		d ^= e >> 16; g += d; e += f;		\
+		e ^= f << 10; h += e; f += g;		\
+		f ^= g >> 4;  a += f; g += h;		\
+		g ^= h << 8;  b += g; h += a;		\
+		h ^= a >> 9;  c += h; a += b;		\
+	} while (0)
+
+/**
+ * Initializes a new isaac with an all zero seed
+ */
+static void isaac_init(isaac_t* isaac)
+{
+	isaac_seed(isaac, NULL, 0);
+}
+
+/**
+ * Properly frees an isaac
+ */
+static void isaac_free(isaac_t* isaac)
+{
+}
+
+/**
+ * Mixes one array into the state during seeding
+ */
+static void isaac_scramble(isaac_t* isaac, const uint32_t* src, uint32_t* s)
+{
+	for (int i = 0; i < ISAAC_SIZE; i += 8) {
+		for (int j = 0; j < 8; j++) {
+			s[j] += src[i+j];
+		}
+		ISAAC_MIX(s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7]);
+		memcpy(&isaac->mem[i], s, 8*sizeof(uint32_t));
+	}
+}
+
+/**
+ * Reseeds the cipher and generates the first batch
+ *  - seed: Seed words, up to ISAAC_SIZE of them. The rest are zero.
+ */
+void isaac_seed(isaac_t* isaac, const uint32_t* seed, size_t len)
+{
+	uint32_t s[8];
+
+	if (len > ISAAC_SIZE) {
+		len = ISAAC_SIZE;
+	}
+	memset(isaac->results, 0, sizeof(isaac->results));
+	if (len > 0) {
+		memcpy(isaac->results, seed, len*sizeof(uint32_t));
+	}
+	isaac->a = isaac->b = isaac->c = 0;
+
+	for (int i = 0; i < 8; i++) {
+		s[i] = GOLDEN_RATIO;
+	}
+	for (int i = 0; i < 4; i++) {
+		ISAAC_MIX(s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7]);
+	}
+	isaac_scramble(isaac, isaac->results, s);
+	isaac_scramble(isaac, isaac->mem, s);
+
+	isaac_generate(isaac);
+}
+
+/**
+ * Generates the next ISAAC_SIZE words of keystream and resets the count
+ */
+void isaac_generate(isaac_t* isaac)
+{
+	uint32_t* mem = isaac->mem;
+	uint32_t a = isaac->a;
+	uint32_t b = isaac->b + ++isaac->c;
+
+	for (int i = 0; i < ISAAC_SIZE; i++) {
+		uint32_t x = mem[i];
+		switch (i & 3) {
+		case 0:
+			a ^= a << 13;
+			break;
+		case 1:
+			a ^= a >> 6;
+			break;
+		case 2:
+			a ^= a << 2;
+			break;
+		case 3:
+			a ^= a >> 16;
+			break;
+		}
+		a += mem[(i + ISAAC_SIZE/2) & (ISAAC_SIZE-1)];
+		uint32_t y = mem[(x >> 2) & (ISAAC_SIZE-1)] + a + b;
+		mem[i] = y;
+		b = mem[(y >> 10) & (ISAAC_SIZE-1)] + x;
+		isaac->results[i] = b;
+	}
+	isaac->a = a;
+	isaac->b = b;
+	isaac->count = ISAAC_SIZE;
+}
+
+/**
+ * Puts an opcode encrypted with the next keystream value
+ * No keystream is used if the codec has no room.
+ */
+void codec_put_opcode(codec_t* codec, isaac_t* isaac, uint8_t opcode)
+{
+	if (!codec_ensure(codec, 1)) {
+		return;
+	}
+	codec_put8_fast(codec, opcode + isaac_next(isaac));
+}
+
+/**
+ * Gets an opcode decrypted with the next keystream value
+ * No keystream is used if the codec is empty.
+ */
+uint8_t codec_get_opcode(codec_t* codec, isaac_t* isaac)
+{
+	if (!codec_has(codec, 1)) {
+		return 0;
+	}
+	return codec_get8_fast(codec) - isaac_next(isaac);
+}
+
+object_proto_t isaac_proto = {
+	.init = (object_init_t)isaac_init,
+	.free = (object_free_t)isaac_free
+};
@@ -163,7 +163,10 @@ void list_erase(list_t* list, list_node_t* node)
 	node->prev = node->next = (list_node_t*)NULL;
 }
 
+static object_slab_t list_slab = OBJECT_SLAB_INITIALIZER;
+
 object_proto_t list_proto = {
 	.init = (object_init_t)list_init,
-	.free = (object_free_t)list_free
+	.free = (object_free_t)list_free,
+	.slab = &list_slab
 };
@@ -1 +1 @@
-OBJECTS += $(addprefix src/util/,list.o sorted_list.o object.o queue.o stack.o codec.o)
+OBJECTS += $(addprefix src/util/,allocator.o list.o sorted_list.o rbtree.o object.o queue.o stack.o futex.o mpsc_queue.o mpmc_ring.o codec.o codec_array.o codec_smart.o codec_pool.o codec_chain.o isaac.o packet.o arena.o thread_pool.o)
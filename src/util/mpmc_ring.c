@@ -0,0 +1,170 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * mpmc_ring.c
+ *
+ * Dmitry Vyukov's bounded MPMC queue. Each cell carries a sequence number
+ * saying whether it is ready to be written or read for a given lap of the
+ * ring, so producers and consumers only contend on their own position
+ * counter.
+ */
+
+#include <runite/util/mpmc_ring.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * Initializes a new ring. It has no capacity until mpmc_ring_alloc.
+ */
+static void mpmc_ring_init(mpmc_ring_t* ring)
+{
+	ring->cells = NULL;
+	ring->mask = 0;
+	ring->enqueue_pos = 0;
+	ring->dequeue_pos = 0;
+	futex_event_init(&ring->event);
+}
+
+/**
+ * Properly frees a ring. Items still queued belong to the caller.
+ */
+static void mpmc_ring_free(mpmc_ring_t* ring)
+{
+	free(ring->cells);
+}
+
+/**
+ * Sets up the ring's storage, before any other thread uses it
+ *  - capacity: Rounded up to a power of two, at least 2
+ */
+bool mpmc_ring_alloc(mpmc_ring_t* ring, size_t capacity)
+{
+	size_t size = 2;
+	while (size < capacity) {
+		if (size > SIZE_MAX / 2) {
+			return false;
+		}
+		size *= 2;
+	}
+
+	mpmc_cell_t* cells = (mpmc_cell_t*)malloc(sizeof(mpmc_cell_t) * size);
+	if (cells == NULL) {
+		return false;
+	}
+	for (size_t i = 0; i < size; i++) {
+		cells[i].seq = i;
+		cells[i].item = NULL;
+	}
+	free(ring->cells);
+	ring->cells = cells;
+	ring->mask = size - 1;
+	ring->enqueue_pos = 0;
+	ring->dequeue_pos = 0;
+	return true;
+}
+
+/**
+ * Pushes an item, from any thread
+ * returns: false if the ring is full
+ */
+bool mpmc_ring_push(mpmc_ring_t* ring, void* item)
+{
+	mpmc_cell_t* cell;
+	size_t pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+	while (true) {
+		cell = &ring->cells[pos & ring->mask];
+		size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+		intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&ring->enqueue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				break;
+			}
+		} else if (diff < 0) {
+			return false;
+		} else {
+			pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+		}
+	}
+	cell->item = item;
+	__atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+	futex_event_signal(&ring->event);
+	return true;
+}
+
+/**
+ * Pops the oldest item, from any thread
+ * returns: The item, or NULL if the ring is empty
+ */
+void* mpmc_ring_pop(mpmc_ring_t* ring)
+{
+	mpmc_cell_t* cell;
+	size_t pos = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+	while (true) {
+		cell = &ring->cells[pos & ring->mask];
+		size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+		intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&ring->dequeue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				break;
+			}
+		} else if (diff < 0) {
+			return NULL;
+		} else {
+			pos = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+		}
+	}
+	void* item = cell->item;
+	__atomic_store_n(&cell->seq, pos + ring->mask + 1, __ATOMIC_RELEASE);
+	return item;
+}
+
+/**
+ * Pops the oldest item, sleeping until one arrives
+ *  - timeout_ms: Longest time to wait, or -1 for no limit
+ * returns: The item, or NULL if the timeout passed
+ */
+void* mpmc_ring_pop_wait(mpmc_ring_t* ring, int timeout_ms)
+{
+	int64_t deadline = futex_deadline(timeout_ms);
+	while (true) {
+		void* item = mpmc_ring_pop(ring);
+		if (item != NULL) {
+			return item;
+		}
+		int remaining = futex_remaining(deadline);
+		if (remaining == 0) {
+			return NULL;
+		}
+
+		uint32_t seq = futex_event_prepare(&ring->event);
+		item = mpmc_ring_pop(ring);
+		if (item != NULL) {
+			futex_event_cancel(&ring->event);
+			return item;
+		}
+		if (!futex_event_wait(&ring->event, seq, remaining)) {
+			return mpmc_ring_pop(ring);
+		}
+	}
+}
+
+object_proto_t mpmc_ring_proto = {
+	.init = (object_init_t)mpmc_ring_init,
+	.free = (object_free_t)mpmc_ring_free
+};
@@ -0,0 +1,160 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * mpsc_queue.c
+ *
+ * Dmitry Vyukov's intrusive MPSC queue. Producers swing head to their
+ * node with one atomic exchange and then link the previous node to it;
+ * the consumer follows next pointers from tail. A stub node keeps the
+ * list from ever being empty. Between a producer's exchange and its link
+ * the queue briefly looks empty to the consumer.
+ */
+
+#include <runite/util/mpsc_queue.h>
+
+#include <assert.h>
+#include <sched.h>
+
+/**
+ * Initializes a new queue
+ */
+static void mpsc_queue_init(mpsc_queue_t* queue)
+{
+	queue->stub.next = NULL;
+	queue->head = &queue->stub;
+	queue->tail = &queue->stub;
+	futex_event_init(&queue->event);
+}
+
+/**
+ * Properly frees a queue. Queued items belong to the caller.
+ */
+static void mpsc_queue_free(mpsc_queue_t* queue)
+{
+
+}
+
+/**
+ * Links a node in at the head
+ */
+static void mpsc_queue_link(mpsc_queue_t* queue, list_node_t* node)
+{
+	__atomic_store_n(&node->next, NULL, __ATOMIC_RELAXED);
+	list_node_t* prev = __atomic_exchange_n(&queue->head, node, __ATOMIC_ACQ_REL);
+	__atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+}
+
+/**
+ * Pushes an item onto the queue, from any thread
+ */
+void mpsc_queue_push(mpsc_queue_t* queue, list_node_t* item)
+{
+	assert(item != NULL);
+	mpsc_queue_link(queue, item);
+	futex_event_signal(&queue->event);
+}
+
+/**
+ * Pops the oldest item, from the consumer thread only
+ * returns: The item, or NULL if the queue is empty or a push is only
+ *          half way through
+ */
+list_node_t* mpsc_queue_pop(mpsc_queue_t* queue)
+{
+	list_node_t* tail = queue->tail;
+	list_node_t* next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+	if (tail == &queue->stub) {
+		if (next == NULL) {
+			return NULL;
+		}
+		queue->tail = next;
+		tail = next;
+		next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	}
+	if (next != NULL) {
+		queue->tail = next;
+		return tail;
+	}
+
+	/* tail is the last node, unless a producer is about to link another */
+	if (tail != __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE)) {
+		return NULL;
+	}
+
+	/* requeue the stub behind tail so tail can be handed out */
+	mpsc_queue_link(queue, &queue->stub);
+	next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	if (next != NULL) {
+		queue->tail = next;
+		return tail;
+	}
+	return NULL;
+}
+
+/**
+ * Pops the oldest item, sleeping until one arrives
+ *  - timeout_ms: Longest time to wait, or -1 for no limit
+ * returns: The item, or NULL if the timeout passed
+ */
+list_node_t* mpsc_queue_pop_wait(mpsc_queue_t* queue, int timeout_ms)
+{
+	int64_t deadline = futex_deadline(timeout_ms);
+	while (true) {
+		list_node_t* node = mpsc_queue_pop(queue);
+		if (node != NULL) {
+			return node;
+		}
+		int remaining = futex_remaining(deadline);
+		if (remaining == 0) {
+			return NULL;
+		}
+
+		uint32_t seq = futex_event_prepare(&queue->event);
+		node = mpsc_queue_pop(queue);
+		if (node != NULL) {
+			futex_event_cancel(&queue->event);
+			return node;
+		}
+		if (!mpsc_queue_empty(queue)) {
+			/* a push is mid-flight and its signal may already be spent */
+			futex_event_cancel(&queue->event);
+			sched_yield();
+			continue;
+		}
+		if (!futex_event_wait(&queue->event, seq, remaining)) {
+			return mpsc_queue_pop(queue);
+		}
+	}
+}
+
+/**
+ * Checks if a queue is empty, from the consumer thread
+ */
+bool mpsc_queue_empty(mpsc_queue_t* queue)
+{
+	list_node_t* tail = queue->tail;
+	return tail == &queue->stub
+		&& __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE) == NULL
+		&& __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) == tail;
+}
+
+object_proto_t mpsc_queue_proto = {
+	.init = (object_init_t)mpsc_queue_init,
+	.free = (object_free_t)mpsc_queue_free
+};
@@ -19,15 +19,209 @@
  * object.c
  *
  * Defines our object system
+ *
+ * Types whose prototype has a slab are allocated from chunks of
+ * equally sized objects instead of one malloc each. Every thread keeps a
+ * short free list per slab, and only takes the slab's lock to move half a
+ * list to or from the shared free list. Slab memory is kept for reuse by
+ * its type and never given back to the system. Builds with
+ * AddressSanitizer always use malloc so it can still see each object.
  */
 #include <runite/util/object.h>
 
+#include <runite/util/config.h>
+
+#if defined(__SANITIZE_ADDRESS__)
+#define OBJECT_SLAB_DISABLED
+#endif
+
+#define OBJECT_SLAB_MAX_TYPES 32
+#define OBJECT_SLAB_CACHE_SIZE 64
+#define OBJECT_SLAB_ALIGN 16
+#define OBJECT_SLAB_ROUND(x) (((x) + OBJECT_SLAB_ALIGN - 1) & ~(size_t)(OBJECT_SLAB_ALIGN - 1))
+
+typedef struct object_slab_cache object_slab_cache_t;
+
+struct object_slab_cache {
+	void* free;
+	int count;
+};
+
+static object_slab_t* slabs[OBJECT_SLAB_MAX_TYPES];
+static int num_slabs = 0;
+static pthread_mutex_t slabs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t slab_key;
+static pthread_once_t slab_key_once = PTHREAD_ONCE_INIT;
+
+static __thread object_slab_cache_t slab_caches[OBJECT_SLAB_MAX_TYPES];
+static __thread bool slab_thread_registered = false;
+
+/* free objects are linked through their first word */
+#define NEXT_FREE(ptr) (*(void**)(ptr))
+
+/**
+ * Moves up to keep objects from the front of a cache to the slab
+ * The slab's lock must be held.
+ */
+static void object_slab_spill(object_slab_t* slab, object_slab_cache_t* cache, int keep)
+{
+	while (cache->count > keep) {
+		void* ptr = cache->free;
+		cache->free = NEXT_FREE(ptr);
+		NEXT_FREE(ptr) = slab->free;
+		slab->free = ptr;
+		cache->count--;
+	}
+}
+
+/**
+ * Thread exit destructor, hands every cached object back to its slab
+ */
+static void object_slab_thread_exit(void* unused)
+{
+	for (int i = 0; i < OBJECT_SLAB_MAX_TYPES; i++) {
+		if (slab_caches[i].count == 0) {
+			continue;
+		}
+		object_slab_t* slab = slabs[i];
+		pthread_mutex_lock(&slab->lock);
+		object_slab_spill(slab, &slab_caches[i], 0);
+		pthread_mutex_unlock(&slab->lock);
+	}
+}
+
+static void object_slab_create_key()
+{
+	pthread_key_create(&slab_key, object_slab_thread_exit);
+}
+
+/**
+ * Gives a slab its index into the thread caches on first use
+ * returns: The cache for the calling thread, or NULL if there are no free
+ *          indices left, in which case the slab is bypassed
+ */
+static object_slab_cache_t* object_slab_cache(object_slab_t* slab, size_t size)
+{
+	int id = __atomic_load_n(&slab->id, __ATOMIC_ACQUIRE);
+	if (id == 0) {
+		pthread_mutex_lock(&slabs_lock);
+		id = slab->id;
+		if (id == 0) {
+			if (num_slabs < OBJECT_SLAB_MAX_TYPES) {
+				slabs[num_slabs++] = slab;
+				id = num_slabs;
+			} else {
+				id = -1;
+			}
+			slab->size = OBJECT_SLAB_ROUND(size);
+			__atomic_store_n(&slab->id, id, __ATOMIC_RELEASE);
+		}
+		pthread_mutex_unlock(&slabs_lock);
+	}
+	if (id < 0) {
+		return NULL;
+	}
+
+	if (!slab_thread_registered) {
+		pthread_once(&slab_key_once, object_slab_create_key);
+		pthread_setspecific(slab_key, slab_caches);
+		slab_thread_registered = true;
+	}
+	return &slab_caches[id-1];
+}
+
+/**
+ * Refills a cache from the slab, carving a new chunk if the slab is empty
+ */
+static void object_slab_refill(object_slab_t* slab, object_slab_cache_t* cache)
+{
+	pthread_mutex_lock(&slab->lock);
+	if (slab->free == NULL) {
+		size_t per_chunk = (DEFAULT_SLAB_CHUNK_SIZE - OBJECT_SLAB_ALIGN) / slab->size;
+		if (per_chunk < 1) {
+			per_chunk = 1;
+		}
+		unsigned char* chunk = (unsigned char*)malloc(OBJECT_SLAB_ALIGN + per_chunk*slab->size);
+		if (chunk == NULL) {
+			pthread_mutex_unlock(&slab->lock);
+			return;
+		}
+		NEXT_FREE(chunk) = slab->chunks;
+		slab->chunks = chunk;
+		for (size_t i = per_chunk; i > 0; i--) {
+			void* ptr = chunk + OBJECT_SLAB_ALIGN + (i-1)*slab->size;
+			NEXT_FREE(ptr) = slab->free;
+			slab->free = ptr;
+		}
+	}
+	while (cache->count < OBJECT_SLAB_CACHE_SIZE/2 && slab->free != NULL) {
+		void* ptr = slab->free;
+		slab->free = NEXT_FREE(ptr);
+		NEXT_FREE(ptr) = cache->free;
+		cache->free = ptr;
+		cache->count++;
+	}
+	pthread_mutex_unlock(&slab->lock);
+}
+
+/**
+ * Allocates an object from a slab
+ */
+static void* object_slab_alloc(object_slab_t* slab, size_t size)
+{
+	object_slab_cache_t* cache = object_slab_cache(slab, size);
+	if (cache == NULL) {
+		return malloc(size);
+	}
+	if (cache->free == NULL) {
+		object_slab_refill(slab, cache);
+		if (cache->free == NULL) {
+			return NULL;
+		}
+	}
+	void* ptr = cache->free;
+	cache->free = NEXT_FREE(ptr);
+	cache->count--;
+	return ptr;
+}
+
+/**
+ * Returns an object to its slab
+ */
+static void object_slab_free(object_slab_t* slab, void* ptr)
+{
+	if (__atomic_load_n(&slab->id, __ATOMIC_RELAXED) < 0) {
+		free(ptr);
+		return;
+	}
+	object_slab_cache_t* cache = object_slab_cache(slab, slab->size);
+	NEXT_FREE(ptr) = cache->free;
+	cache->free = ptr;
+	if (++cache->count > OBJECT_SLAB_CACHE_SIZE) {
+		pthread_mutex_lock(&slab->lock);
+		object_slab_spill(slab, cache, OBJECT_SLAB_CACHE_SIZE/2);
+		pthread_mutex_unlock(&slab->lock);
+	}
+}
+
 /**
  * Allocates and initializes an object
+ * returns: The object, or NULL if it couldn't be allocated
  */
-object_t* _object_new(object_proto_t proto, size_t size)
+object_t* _object_new(const object_proto_t* proto, size_t size)
 {
-	object_t* object = (object_t*)malloc(size);
+	object_t* object;
+#ifndef OBJECT_SLAB_DISABLED
+	if (proto->slab != NULL) {
+		object = (object_t*)object_slab_alloc(proto->slab, size);
+	} else
+#endif
+	{
+		object = (object_t*)malloc(size);
+	}
+	if (object == NULL) {
+		return NULL;
+	}
 	_object_init(proto, object);
 	object->must_free = true;
 	return object;
@@ -36,11 +230,10 @@ object_t* _object_new(object_proto_t proto, size_t size)
 /**
  * Initializes an object
  */
-void _object_init(object_proto_t proto, object_t* object)
+void _object_init(const object_proto_t* proto, object_t* object)
 {
-	proto.init(object);
-	object->prototype.init = proto.init;
-	object->prototype.free = proto.free;
+	proto->init(object);
+	object->prototype = proto;
 	object->must_free = false;
 }
 
@@ -49,8 +242,16 @@ void _object_init(object_proto_t proto, object_t* object)
  */
 void _object_free(object_t* object)
 {
-	object->prototype.free(object);
-	if (object->must_free) {
-		free(object);
+	const object_proto_t* proto = object->prototype;
+	proto->free(object);
+	if (!object->must_free) {
+		return;
+	}
+#ifndef OBJECT_SLAB_DISABLED
+	if (proto->slab != NULL) {
+		object_slab_free(proto->slab, object);
+		return;
 	}
+#endif
+	free(object);
 }
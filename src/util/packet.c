@@ -0,0 +1,135 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * packet.c
+ *
+ * In place packet framing, see packet.h
+ */
+
+#include <runite/util/packet.h>
+
+#include <runite/util/codec_fast.h>
+
+/**
+ * Gets the number of size bytes for a packet type
+ */
+static size_t packet_size_bytes(int type)
+{
+	switch (type) {
+	case PACKET_VAR_BYTE:
+		return 1;
+	case PACKET_VAR_SHORT:
+		return 2;
+	default:
+		return 0;
+	}
+}
+
+/**
+ * Begins a packet at the codec's caret, reserving the opcode and size
+ *  - isaac: The cipher for the opcode, or NULL to send it in the clear.
+ *           Keystream is only used once the packet ends successfully.
+ *  - type: One of PACKET_FIXED, PACKET_VAR_BYTE, PACKET_VAR_SHORT
+ * returns: Whether there was room for the header
+ */
+bool packet_begin(packet_t* packet, codec_t* codec, isaac_t* isaac, uint8_t opcode, int type)
+{
+	size_t header_len = 1 + packet_size_bytes(type);
+
+	packet->codec = codec;
+	packet->isaac = isaac;
+	packet->start = codec->caret;
+	packet->prev_size = codec->size;
+	packet->prev_overflow = codec->overflow;
+	packet->opcode = opcode;
+	packet->type = type;
+
+	/* a body write that doesn't fit will set it again */
+	codec->overflow = false;
+	if (!codec_ensure(codec, header_len)) {
+		codec->overflow = packet->prev_overflow;
+		return false;
+	}
+	memset(codec->data + codec->caret, 0, header_len);
+	codec->caret += header_len;
+	codec_mark(codec);
+	packet->body = codec->caret;
+	return true;
+}
+
+/**
+ * Gets the number of body bytes written so far
+ */
+size_t packet_len(packet_t* packet)
+{
+	return packet->codec->caret - packet->body;
+}
+
+/**
+ * Finishes a packet, filling in its opcode and size
+ * returns: Whether the whole body was written and fit the size slot. If
+ *          not, the packet is removed from the codec as if it was never
+ *          begun.
+ */
+bool packet_end(packet_t* packet)
+{
+	codec_t* codec = packet->codec;
+	size_t len = packet_len(packet);
+	unsigned char* header = codec->data + packet->start;
+
+	/* a write the codec had no room for was dropped, leaving the body short */
+	if (codec->overflow) {
+		goto error;
+	}
+
+	switch (packet->type) {
+	case PACKET_VAR_BYTE:
+		if (len > UINT8_MAX) {
+			goto error;
+		}
+		header[1] = len;
+		break;
+	case PACKET_VAR_SHORT:
+		if (len > UINT16_MAX) {
+			goto error;
+		}
+		codec_store16(header + 1, len);
+		break;
+	}
+
+	header[0] = packet->opcode;
+	if (packet->isaac != NULL) {
+		header[0] += isaac_next(packet->isaac);
+	}
+	codec->overflow = packet->prev_overflow;
+	return true;
+
+error:
+	packet_abort(packet);
+	return false;
+}
+
+/**
+ * Removes a packet from the codec, discarding its header and body
+ */
+void packet_abort(packet_t* packet)
+{
+	packet->codec->caret = packet->start;
+	packet->codec->size = packet->prev_size;
+	packet->codec->overflow = packet->prev_overflow;
+}
@@ -0,0 +1,350 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * rbtree.c
+ *
+ * A red-black tree, giving O(log n) insert, find and erase. Items which
+ * compare equal are kept in insertion order.
+ */
+
+#include <runite/util/rbtree.h>
+
+/**
+ * Initializes a new rbtree_t
+ */
+static void rbtree_init(rbtree_t* tree)
+{
+	tree->root = NULL;
+	tree->compare_func = NULL;
+	tree->count = 0;
+}
+
+/**
+ * Properly frees an rbtree_t
+ * The nodes belong to the caller and are left alone.
+ */
+static void rbtree_free(rbtree_t* tree)
+{
+
+}
+
+static bool rbtree_is_red(rbtree_node_t* node)
+{
+	return node != NULL && node->color == RBTREE_RED;
+}
+
+static rbtree_node_t* rbtree_min(rbtree_node_t* node)
+{
+	while (node->left != NULL) {
+		node = node->left;
+	}
+	return node;
+}
+
+static rbtree_node_t* rbtree_max(rbtree_node_t* node)
+{
+	while (node->right != NULL) {
+		node = node->right;
+	}
+	return node;
+}
+
+/**
+ * Puts new in old's place under old's parent
+ */
+static void rbtree_replace(rbtree_t* tree, rbtree_node_t* old, rbtree_node_t* new)
+{
+	if (old->parent == NULL) {
+		tree->root = new;
+	} else if (old == old->parent->left) {
+		old->parent->left = new;
+	} else {
+		old->parent->right = new;
+	}
+	if (new != NULL) {
+		new->parent = old->parent;
+	}
+}
+
+static void rbtree_rotate_left(rbtree_t* tree, rbtree_node_t* node)
+{
+	rbtree_node_t* right = node->right;
+	node->right = right->left;
+	if (right->left != NULL) {
+		right->left->parent = node;
+	}
+	rbtree_replace(tree, node, right);
+	right->left = node;
+	node->parent = right;
+}
+
+static void rbtree_rotate_right(rbtree_t* tree, rbtree_node_t* node)
+{
+	rbtree_node_t* left = node->left;
+	node->left = left->right;
+	if (left->right != NULL) {
+		left->right->parent = node;
+	}
+	rbtree_replace(tree, node, left);
+	left->right = node;
+	node->parent = left;
+}
+
+/**
+ * Checks whether a tree is empty
+ */
+bool rbtree_empty(rbtree_t* tree)
+{
+	return tree->root == NULL;
+}
+
+/**
+ * Inserts a node, after any nodes which compare equal to it
+ */
+void rbtree_insert(rbtree_t* tree, rbtree_node_t* node)
+{
+	rbtree_node_t* parent = NULL;
+	rbtree_node_t** link = &tree->root;
+	while (*link != NULL) {
+		parent = *link;
+		if (tree->compare_func(node, parent) < 0) {
+			link = &parent->left;
+		} else {
+			link = &parent->right;
+		}
+	}
+	node->parent = parent;
+	node->left = node->right = NULL;
+	node->color = RBTREE_RED;
+	*link = node;
+	tree->count++;
+
+	/* restore the red-black properties */
+	while (rbtree_is_red(node->parent)) {
+		parent = node->parent;
+		rbtree_node_t* grandparent = parent->parent;
+		if (parent == grandparent->left) {
+			rbtree_node_t* uncle = grandparent->right;
+			if (rbtree_is_red(uncle)) {
+				parent->color = uncle->color = RBTREE_BLACK;
+				grandparent->color = RBTREE_RED;
+				node = grandparent;
+				continue;
+			}
+			if (node == parent->right) {
+				rbtree_rotate_left(tree, parent);
+				node = parent;
+				parent = node->parent;
+			}
+			parent->color = RBTREE_BLACK;
+			grandparent->color = RBTREE_RED;
+			rbtree_rotate_right(tree, grandparent);
+		} else {
+			rbtree_node_t* uncle = grandparent->left;
+			if (rbtree_is_red(uncle)) {
+				parent->color = uncle->color = RBTREE_BLACK;
+				grandparent->color = RBTREE_RED;
+				node = grandparent;
+				continue;
+			}
+			if (node == parent->left) {
+				rbtree_rotate_right(tree, parent);
+				node = parent;
+				parent = node->parent;
+			}
+			parent->color = RBTREE_BLACK;
+			grandparent->color = RBTREE_RED;
+			rbtree_rotate_left(tree, grandparent);
+		}
+	}
+	tree->root->color = RBTREE_BLACK;
+}
+
+/**
+ * Rebalances after removing a black node
+ *  - node: The node which took its place, possibly NULL
+ *  - parent: node's parent
+ */
+static void rbtree_erase_fixup(rbtree_t* tree, rbtree_node_t* node, rbtree_node_t* parent)
+{
+	while (node != tree->root && !rbtree_is_red(node)) {
+		if (node == parent->left) {
+			rbtree_node_t* sibling = parent->right;
+			if (rbtree_is_red(sibling)) {
+				sibling->color = RBTREE_BLACK;
+				parent->color = RBTREE_RED;
+				rbtree_rotate_left(tree, parent);
+				sibling = parent->right;
+			}
+			if (!rbtree_is_red(sibling->left) && !rbtree_is_red(sibling->right)) {
+				sibling->color = RBTREE_RED;
+				node = parent;
+				parent = node->parent;
+				continue;
+			}
+			if (!rbtree_is_red(sibling->right)) {
+				sibling->left->color = RBTREE_BLACK;
+				sibling->color = RBTREE_RED;
+				rbtree_rotate_right(tree, sibling);
+				sibling = parent->right;
+			}
+			sibling->color = parent->color;
+			parent->color = RBTREE_BLACK;
+			sibling->right->color = RBTREE_BLACK;
+			rbtree_rotate_left(tree, parent);
+		} else {
+			rbtree_node_t* sibling = parent->left;
+			if (rbtree_is_red(sibling)) {
+				sibling->color = RBTREE_BLACK;
+				parent->color = RBTREE_RED;
+				rbtree_rotate_right(tree, parent);
+				sibling = parent->left;
+			}
+			if (!rbtree_is_red(sibling->left) && !rbtree_is_red(sibling->right)) {
+				sibling->color = RBTREE_RED;
+				node = parent;
+				parent = node->parent;
+				continue;
+			}
+			if (!rbtree_is_red(sibling->left)) {
+				sibling->right->color = RBTREE_BLACK;
+				sibling->color = RBTREE_RED;
+				rbtree_rotate_left(tree, sibling);
+				sibling = parent->left;
+			}
+			sibling->color = parent->color;
+			parent->color = RBTREE_BLACK;
+			sibling->left->color = RBTREE_BLACK;
+			rbtree_rotate_right(tree, parent);
+		}
+		node = tree->root;
+	}
+	if (node != NULL) {
+		node->color = RBTREE_BLACK;
+	}
+}
+
+/**
+ * Removes a node from the tree
+ */
+void rbtree_erase(rbtree_t* tree, rbtree_node_t* node)
+{
+	rbtree_node_t* child;
+	rbtree_node_t* parent;
+	int removed_color = node->color;
+
+	if (node->left == NULL) {
+		child = node->right;
+		parent = node->parent;
+		rbtree_replace(tree, node, child);
+	} else if (node->right == NULL) {
+		child = node->left;
+		parent = node->parent;
+		rbtree_replace(tree, node, child);
+	} else {
+		/* swap in the successor, which has no left child */
+		rbtree_node_t* successor = rbtree_min(node->right);
+		removed_color = successor->color;
+		child = successor->right;
+		if (successor->parent == node) {
+			parent = successor;
+		} else {
+			parent = successor->parent;
+			rbtree_replace(tree, successor, child);
+			successor->right = node->right;
+			successor->right->parent = successor;
+		}
+		rbtree_replace(tree, node, successor);
+		successor->left = node->left;
+		successor->left->parent = successor;
+		successor->color = node->color;
+	}
+	tree->count--;
+
+	if (removed_color == RBTREE_BLACK) {
+		rbtree_erase_fixup(tree, child, parent);
+	}
+	node->parent = node->left = node->right = NULL;
+}
+
+/**
+ * Finds the first node which compares equal to key
+ * returns: The node, or NULL if there isn't one
+ */
+rbtree_node_t* rbtree_find(rbtree_t* tree, rbtree_node_t* key)
+{
+	rbtree_node_t* node = tree->root;
+	rbtree_node_t* found = NULL;
+	while (node != NULL) {
+		int cmp_result = tree->compare_func(key, node);
+		if (cmp_result == 0) {
+			found = node;
+		}
+		node = cmp_result <= 0 ? node->left : node->right;
+	}
+	return found;
+}
+
+/**
+ * Gets the smallest node, or NULL if the tree is empty
+ */
+rbtree_node_t* rbtree_first(rbtree_t* tree)
+{
+	return tree->root != NULL ? rbtree_min(tree->root) : NULL;
+}
+
+/**
+ * Gets the largest node, or NULL if the tree is empty
+ */
+rbtree_node_t* rbtree_last(rbtree_t* tree)
+{
+	return tree->root != NULL ? rbtree_max(tree->root) : NULL;
+}
+
+/**
+ * Gets the node after a given node in order, or NULL at the end
+ */
+rbtree_node_t* rbtree_next(rbtree_node_t* node)
+{
+	if (node->right != NULL) {
+		return rbtree_min(node->right);
+	}
+	while (node->parent != NULL && node == node->parent->right) {
+		node = node->parent;
+	}
+	return node->parent;
+}
+
+/**
+ * Gets the node before a given node in order, or NULL at the start
+ */
+rbtree_node_t* rbtree_prev(rbtree_node_t* node)
+{
+	if (node->left != NULL) {
+		return rbtree_max(node->left);
+	}
+	while (node->parent != NULL && node == node->parent->left) {
+		node = node->parent;
+	}
+	return node->parent;
+}
+
+object_proto_t rbtree_proto = {
+	.init = (object_init_t)rbtree_init,
+	.free = (object_free_t)rbtree_free
+};
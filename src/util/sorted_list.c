@@ -87,6 +87,81 @@ void sorted_list_insert(sorted_list_t* list, list_node_t* node)
 	}
 }
 
+/**
+ * Adds a node to the end of a sorted list without ordering it
+ * The list must be put in order with sorted_list_sort before it is used.
+ */
+void sorted_list_append(sorted_list_t* list, list_node_t* node)
+{
+	list_push_back(&list->list, node);
+}
+
+/**
+ * Merges two sorted chains linked through next, keeping a's nodes
+ * ahead of equal nodes from b
+ */
+static list_node_t* sorted_list_merge(sorted_list_t* list, list_node_t* a, list_node_t* b)
+{
+	list_node_t head;
+	list_node_t* tail = &head;
+	while (a != NULL && b != NULL) {
+		if (list->compare_func(b, a) < 0) {
+			tail->next = b;
+			b = b->next;
+		} else {
+			tail->next = a;
+			a = a->next;
+		}
+		tail = tail->next;
+	}
+	tail->next = a != NULL ? a : b;
+	return head.next;
+}
+
+/**
+ * Sorts the whole list, for lists built with sorted_list_append
+ * This is a stable O(n log n) merge sort, so appending everything and
+ * sorting once beats sorted_list_insert for all but small lists.
+ */
+void sorted_list_sort(sorted_list_t* list)
+{
+	/* pending[i] is a sorted run of 2^i nodes, or NULL */
+	list_node_t* pending[sizeof(size_t)*8] = { NULL };
+	int max_level = 0;
+
+	list_node_t* node = list_front(&list->list);
+	while (node != NULL) {
+		list_node_t* next = node->next;
+		node->next = NULL;
+		int level = 0;
+		while (pending[level] != NULL) {
+			node = sorted_list_merge(list, pending[level], node);
+			pending[level++] = NULL;
+		}
+		pending[level] = node;
+		if (level > max_level) {
+			max_level = level;
+		}
+		node = next;
+	}
+
+	list_node_t* sorted = NULL;
+	for (int level = 0; level <= max_level; level++) {
+		if (pending[level] != NULL) {
+			sorted = sorted != NULL ? sorted_list_merge(list, pending[level], sorted) : pending[level];
+		}
+	}
+
+	/* relink the prev pointers */
+	list->list.top = sorted;
+	list_node_t* prev = NULL;
+	for (node = sorted; node != NULL; node = node->next) {
+		node->prev = prev;
+		prev = node;
+	}
+	list->list.bottom = prev;
+}
+
 object_proto_t sorted_list_proto = {
 	.init = (object_init_t)sorted_list_init,
 	.free = (object_free_t)sorted_list_free
@@ -0,0 +1,656 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+/**
+ * thread_pool.c
+ *
+ * A work stealing thread pool. Tasks submitted from outside the pool go
+ * through a shared FIFO injector so they're started in submission order.
+ * Tasks submitted from within a task go to the worker's own Chase-Lev
+ * deque, which it pops newest-first without taking a lock while idle
+ * workers steal oldest-first.
+ */
+
+#include <runite/util/thread_pool.h>
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TASK_DEQUE_INITIAL_CAPACITY 64
+#define TASK_QUEUE_INITIAL_CAPACITY 64
+#define PARALLEL_FOR_CHUNKS_PER_WORKER 8
+
+typedef struct parallel_for parallel_for_t;
+typedef struct parallel_range parallel_range_t;
+
+/**
+ * The shared state of one thread_pool_parallel_for call
+ */
+struct parallel_for {
+	thread_pool_t* pool;
+	task_group_t group;
+	range_func_t func;
+	void* arg;
+	size_t begin;
+	size_t end;
+	size_t grain;
+	parallel_range_t* ranges;
+	size_t next_range;
+};
+
+/**
+ * A run of chunks [first, last) of a parallel_for_t
+ */
+struct parallel_range {
+	parallel_for_t* loop;
+	size_t first;
+	size_t last;
+};
+
+static __thread thread_worker_t* current_worker = NULL;
+
+/**
+ * Reads the monotonic clock in nanoseconds
+ */
+static uint64_t thread_pool_now()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec*1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * Stores a task into a deque slot. Thieves may read the slot while the
+ * owner writes it, so each field goes through an atomic.
+ */
+static void task_store(task_t* slot, task_t* task)
+{
+	__atomic_store_n(&slot->func, task->func, __ATOMIC_RELAXED);
+	__atomic_store_n(&slot->arg, task->arg, __ATOMIC_RELAXED);
+	__atomic_store_n(&slot->group, task->group, __ATOMIC_RELAXED);
+}
+
+/**
+ * Loads a task from a deque slot
+ */
+static void task_load(task_t* slot, task_t* task)
+{
+	task->func = __atomic_load_n(&slot->func, __ATOMIC_RELAXED);
+	task->arg = __atomic_load_n(&slot->arg, __ATOMIC_RELAXED);
+	task->group = __atomic_load_n(&slot->group, __ATOMIC_RELAXED);
+}
+
+/**
+ * Allocates a task_array_t
+ *  - capacity: A power of two
+ */
+static task_array_t* task_array_new(size_t capacity, task_array_t* prev)
+{
+	task_array_t* array = (task_array_t*)malloc(sizeof(task_array_t) + sizeof(task_t)*capacity);
+	if (array != NULL) {
+		array->capacity = capacity;
+		array->prev = prev;
+	}
+	return array;
+}
+
+/**
+ * Initializes a task_deque_t
+ */
+static bool task_deque_init(task_deque_t* deque)
+{
+	deque->top = 0;
+	deque->bottom = 0;
+	deque->array = task_array_new(TASK_DEQUE_INITIAL_CAPACITY, NULL);
+	return deque->array != NULL;
+}
+
+/**
+ * Cleans up a task_deque_t, along with every array it has outgrown
+ */
+static void task_deque_free(task_deque_t* deque)
+{
+	task_array_t* array = deque->array;
+	while (array != NULL) {
+		task_array_t* prev = array->prev;
+		free(array);
+		array = prev;
+	}
+	deque->array = NULL;
+}
+
+/**
+ * Pushes a task to the bottom of a deque, growing it as necessary.
+ * Only called by the owning worker.
+ * returns: false if the deque couldn't grow
+ */
+static bool task_deque_push(task_deque_t* deque, task_t* task)
+{
+	long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+	long top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+	task_array_t* array = __atomic_load_n(&deque->array, __ATOMIC_RELAXED);
+
+	if (bottom - top >= (long)array->capacity) {
+		task_array_t* grown = task_array_new(array->capacity*2, array);
+		if (grown == NULL) {
+			return false;
+		}
+		for (long i = top; i < bottom; i++) {
+			task_t moved;
+			task_load(&array->tasks[i & (array->capacity-1)], &moved);
+			task_store(&grown->tasks[i & (grown->capacity-1)], &moved);
+		}
+		__atomic_store_n(&deque->array, grown, __ATOMIC_RELEASE);
+		array = grown;
+	}
+
+	task_store(&array->tasks[bottom & (array->capacity-1)], task);
+	__atomic_store_n(&deque->bottom, bottom+1, __ATOMIC_RELEASE);
+	return true;
+}
+
+/**
+ * Pops the newest task from the bottom of a deque. Only called by the
+ * owning worker.
+ * returns: Whether a task was popped
+ */
+static bool task_deque_pop(task_deque_t* deque, task_t* task)
+{
+	long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+	task_array_t* array = __atomic_load_n(&deque->array, __ATOMIC_RELAXED);
+	__atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	long top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+	if (top > bottom) {
+		__atomic_store_n(&deque->bottom, bottom+1, __ATOMIC_RELAXED);
+		return false;
+	}
+
+	task_load(&array->tasks[bottom & (array->capacity-1)], task);
+	if (top == bottom) {
+		/* the last task, race any thieves for it */
+		bool won = __atomic_compare_exchange_n(&deque->top, &top, top+1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+		__atomic_store_n(&deque->bottom, bottom+1, __ATOMIC_RELAXED);
+		return won;
+	}
+	return true;
+}
+
+/**
+ * Steals the oldest task from the top of a deque, from any thread
+ * returns: Whether a task was stolen. May fail spuriously when racing
+ *          another thief.
+ */
+static bool task_deque_steal(task_deque_t* deque, task_t* task)
+{
+	long top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+
+	if (top >= bottom) {
+		return false;
+	}
+
+	task_array_t* array = __atomic_load_n(&deque->array, __ATOMIC_ACQUIRE);
+	task_load(&array->tasks[top & (array->capacity-1)], task);
+	return __atomic_compare_exchange_n(&deque->top, &top, top+1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+/**
+ * Initializes a task_queue_t
+ */
+static void task_queue_init(task_queue_t* queue)
+{
+	pthread_mutex_init(&queue->lock, NULL);
+	queue->tasks = NULL;
+	queue->head = queue->tail = 0;
+	queue->capacity = 0;
+}
+
+/**
+ * Cleans up a task_queue_t
+ */
+static void task_queue_free(task_queue_t* queue)
+{
+	pthread_mutex_destroy(&queue->lock);
+	free(queue->tasks);
+}
+
+/**
+ * Pushes a task to the back of a queue, growing it as necessary
+ * returns: false if the queue was full and couldn't be grown
+ */
+static bool task_queue_push(task_queue_t* queue, task_t* task)
+{
+	pthread_mutex_lock(&queue->lock);
+	if (queue->tail - queue->head == queue->capacity) {
+		size_t capacity = queue->capacity ? queue->capacity*2 : TASK_QUEUE_INITIAL_CAPACITY;
+		task_t* tasks = (task_t*)malloc(sizeof(task_t)*capacity);
+		if (tasks == NULL) {
+			pthread_mutex_unlock(&queue->lock);
+			return false;
+		}
+		for (size_t i = queue->head; i < queue->tail; i++) {
+			tasks[i % capacity] = queue->tasks[i % queue->capacity];
+		}
+		free(queue->tasks);
+		queue->tasks = tasks;
+		queue->capacity = capacity;
+	}
+	queue->tasks[queue->tail++ % queue->capacity] = *task;
+	pthread_mutex_unlock(&queue->lock);
+	return true;
+}
+
+/**
+ * Pops the oldest task from a queue
+ * returns: Whether a task was popped
+ */
+static bool task_queue_pop(task_queue_t* queue, task_t* task)
+{
+	bool found = false;
+	pthread_mutex_lock(&queue->lock);
+	if (queue->tail != queue->head) {
+		*task = queue->tasks[queue->head++ % queue->capacity];
+		found = true;
+	}
+	pthread_mutex_unlock(&queue->lock);
+	return found;
+}
+
+/**
+ * Bumps one of a worker's counters. Only the worker writes its counters,
+ * but thread_pool_get_stats reads them from other threads.
+ */
+static void thread_worker_count(uint64_t* counter, uint64_t amount)
+{
+	__atomic_store_n(counter, *counter + amount, __ATOMIC_RELAXED);
+}
+
+/**
+ * Finds a task to run: from our own deque, then the injector, then by
+ * stealing from another worker
+ *  - worker: The calling worker, or NULL if called from outside the pool
+ * returns: Whether a task was found
+ */
+static bool thread_pool_find_task(thread_pool_t* pool, thread_worker_t* worker, task_t* task)
+{
+	if (worker != NULL && task_deque_pop(&worker->deque, task)) {
+		goto found;
+	}
+	if (task_queue_pop(&pool->injector, task)) {
+		goto found;
+	}
+	int start = worker != NULL ? worker->id+1 : 0;
+	for (int i = 0; i < pool->num_workers; i++) {
+		thread_worker_t* victim = &pool->workers[(start+i) % pool->num_workers];
+		if (victim != worker && task_deque_steal(&victim->deque, task)) {
+			if (worker != NULL) {
+				thread_worker_count(&worker->stats.tasks_stolen, 1);
+			}
+			goto found;
+		}
+	}
+	return false;
+found:
+	__atomic_sub_fetch(&pool->num_queued, 1, __ATOMIC_SEQ_CST);
+	return true;
+}
+
+/**
+ * Runs a task and signals its group if it was the last one
+ *  - worker: The calling worker, or NULL if called from outside the pool
+ */
+static void thread_pool_run_task(thread_worker_t* worker, task_t* task)
+{
+	/* tasks run while waiting inside another task are already being timed */
+	bool timed = worker != NULL && worker->depth++ == 0;
+	uint64_t start = timed ? thread_pool_now() : 0;
+
+	task->func(task->arg);
+
+	if (worker != NULL) {
+		worker->depth--;
+		thread_worker_count(&worker->stats.tasks_run, 1);
+		if (timed) {
+			thread_worker_count(&worker->stats.busy_ns, thread_pool_now() - start);
+		}
+	}
+
+	task_group_t* group = task->group;
+	if (group != NULL) {
+		pthread_mutex_lock(&group->lock);
+		if (--group->pending == 0) {
+			pthread_cond_broadcast(&group->done);
+		}
+		pthread_mutex_unlock(&group->lock);
+	}
+}
+
+/**
+ * The worker thread's main loop
+ */
+static void* thread_worker_main(void* arg)
+{
+	thread_worker_t* worker = (thread_worker_t*)arg;
+	thread_pool_t* pool = worker->pool;
+	current_worker = worker;
+
+	while (true) {
+		task_t task;
+		if (thread_pool_find_task(pool, worker, &task)) {
+			thread_pool_run_task(worker, &task);
+			continue;
+		}
+
+		pthread_mutex_lock(&pool->lock);
+		while (!pool->stopping && __atomic_load_n(&pool->num_queued, __ATOMIC_SEQ_CST) == 0) {
+			thread_worker_count(&worker->stats.idle_waits, 1);
+			pthread_cond_wait(&pool->wake, &pool->lock);
+		}
+		bool stop = pool->stopping && __atomic_load_n(&pool->num_queued, __ATOMIC_SEQ_CST) == 0;
+		pthread_mutex_unlock(&pool->lock);
+		if (stop) {
+			break;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Initializes a new thread_pool_t
+ * No threads are created until thread_pool_start is called
+ */
+static void thread_pool_init(thread_pool_t* pool)
+{
+	pool->num_workers = 0;
+	pool->workers = NULL;
+	pool->num_queued = 0;
+	pool->stopping = false;
+	task_queue_init(&pool->injector);
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->wake, NULL);
+}
+
+/**
+ * Properly frees a thread_pool_t
+ * Any queued tasks are run before the workers exit
+ */
+static void thread_pool_free(thread_pool_t* pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	pool->stopping = true;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (int i = 0; i < pool->num_workers; i++) {
+		if (pool->workers[i].started) {
+			pthread_join(pool->workers[i].thread, NULL);
+		}
+	}
+	/* only free the deques once nobody can be stealing from them */
+	for (int i = 0; i < pool->num_workers; i++) {
+		task_deque_free(&pool->workers[i].deque);
+	}
+	free(pool->workers);
+	task_queue_free(&pool->injector);
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->wake);
+}
+
+/**
+ * Starts the pool's worker threads
+ *  - num_workers: The number of threads to start, or 0 for one per core
+ */
+bool thread_pool_start(thread_pool_t* pool, int num_workers)
+{
+	if (pool->workers != NULL) {
+		return false;
+	}
+	if (num_workers <= 0) {
+		num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+		if (num_workers <= 0) {
+			num_workers = 1;
+		}
+	}
+
+	pool->workers = (thread_worker_t*)calloc(num_workers, sizeof(thread_worker_t));
+	if (pool->workers == NULL) {
+		return false;
+	}
+	bool success = true;
+	for (int i = 0; i < num_workers; i++) {
+		thread_worker_t* worker = &pool->workers[i];
+		worker->pool = pool;
+		worker->id = i;
+		success = task_deque_init(&worker->deque) && success;
+	}
+	pool->num_workers = num_workers;
+	if (!success) {
+		return false;
+	}
+	/* every deque must exist before any worker goes looking to steal */
+	for (int i = 0; i < num_workers; i++) {
+		thread_worker_t* worker = &pool->workers[i];
+		worker->started = pthread_create(&worker->thread, NULL, thread_worker_main, worker) == 0;
+		success = success && worker->started;
+	}
+	return success;
+}
+
+/**
+ * Queues a task on the pool. If it can't be queued, it's run on the
+ * calling thread instead before this returns.
+ *  - group: The group to account the task to, or NULL
+ *  - func: The task function
+ *  - arg: An argument to pass to func
+ */
+void thread_pool_submit(thread_pool_t* pool, task_group_t* group, task_func_t func, void* arg)
+{
+	task_t task = {
+		.func = func,
+		.arg = arg,
+		.group = group
+	};
+
+	if (group != NULL) {
+		pthread_mutex_lock(&group->lock);
+		group->pending++;
+		pthread_mutex_unlock(&group->lock);
+	}
+
+	__atomic_add_fetch(&pool->num_queued, 1, __ATOMIC_SEQ_CST);
+	thread_worker_t* worker = current_worker;
+	if (worker != NULL && worker->pool != pool) {
+		worker = NULL;
+	}
+	if (worker == NULL || !task_deque_push(&worker->deque, &task)) {
+		if (!task_queue_push(&pool->injector, &task)) {
+			__atomic_sub_fetch(&pool->num_queued, 1, __ATOMIC_SEQ_CST);
+			thread_pool_run_task(worker, &task);
+			return;
+		}
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pthread_cond_signal(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Runs a range of chunks, handing the upper half off to the pool until
+ * only one chunk is left to run here
+ */
+static void parallel_for_run(parallel_range_t* range)
+{
+	parallel_for_t* loop = range->loop;
+	size_t first = range->first;
+	size_t last = range->last;
+
+	while (last - first > 1) {
+		size_t mid = first + (last - first)/2;
+		parallel_range_t* split = &loop->ranges[__atomic_fetch_add(&loop->next_range, 1, __ATOMIC_RELAXED)];
+		split->loop = loop;
+		split->first = mid;
+		split->last = last;
+		thread_pool_submit(loop->pool, &loop->group, (task_func_t)parallel_for_run, split);
+		last = mid;
+	}
+
+	size_t begin = loop->begin + first*loop->grain;
+	size_t end = loop->end - begin > loop->grain ? begin + loop->grain : loop->end;
+	loop->func(loop->arg, begin, end);
+}
+
+/**
+ * Calls func over [begin, end) in chunks spread across the pool, and
+ * waits for them all. The calling thread takes part.
+ *  - pool: The pool to run on, or NULL to run on the calling thread
+ *  - grain: The largest range to pass to func at once, or 0 to pick one
+ *           from the number of workers
+ *  - func: Called as func(arg, chunk_begin, chunk_end)
+ */
+void thread_pool_parallel_for(thread_pool_t* pool, size_t begin, size_t end, size_t grain, range_func_t func, void* arg)
+{
+	if (begin >= end) {
+		return;
+	}
+	size_t count = end - begin;
+	if (pool == NULL || pool->num_workers == 0) {
+		func(arg, begin, end);
+		return;
+	}
+	if (grain == 0) {
+		grain = count / ((size_t)pool->num_workers * PARALLEL_FOR_CHUNKS_PER_WORKER);
+		if (grain == 0) {
+			grain = 1;
+		}
+	}
+
+	parallel_for_t loop;
+	loop.pool = pool;
+	loop.func = func;
+	loop.arg = arg;
+	loop.begin = begin;
+	loop.end = end;
+	loop.grain = grain;
+	loop.next_range = 0;
+
+	size_t num_chunks = (count - 1)/grain + 1;
+	loop.ranges = (parallel_range_t*)malloc(sizeof(parallel_range_t)*num_chunks);
+	if (loop.ranges == NULL) {
+		func(arg, begin, end);
+		return;
+	}
+	object_init(task_group, &loop.group);
+
+	parallel_range_t root = {
+		.loop = &loop,
+		.first = 0,
+		.last = num_chunks
+	};
+	parallel_for_run(&root);
+	task_group_wait(pool, &loop.group);
+
+	object_free(&loop.group);
+	free(loop.ranges);
+}
+
+/**
+ * Reads a worker's utilization counters. busy_ns over the pool's lifetime
+ * gives the fraction of time the worker spent running tasks.
+ *  - worker: The worker's index, from 0 to num_workers-1
+ * returns: false if there's no such worker
+ */
+bool thread_pool_get_stats(thread_pool_t* pool, int worker, thread_worker_stats_t* stats)
+{
+	if (worker < 0 || worker >= pool->num_workers) {
+		return false;
+	}
+	thread_worker_stats_t* counters = &pool->workers[worker].stats;
+	stats->tasks_run = __atomic_load_n(&counters->tasks_run, __ATOMIC_RELAXED);
+	stats->tasks_stolen = __atomic_load_n(&counters->tasks_stolen, __ATOMIC_RELAXED);
+	stats->busy_ns = __atomic_load_n(&counters->busy_ns, __ATOMIC_RELAXED);
+	stats->idle_waits = __atomic_load_n(&counters->idle_waits, __ATOMIC_RELAXED);
+	return true;
+}
+
+/**
+ * Waits for every task in a group to complete
+ * The calling thread runs queued tasks while it waits.
+ */
+void task_group_wait(thread_pool_t* pool, task_group_t* group)
+{
+	thread_worker_t* worker = current_worker;
+	if (worker != NULL && worker->pool != pool) {
+		worker = NULL;
+	}
+
+	while (true) {
+		pthread_mutex_lock(&group->lock);
+		bool done = group->pending == 0;
+		pthread_mutex_unlock(&group->lock);
+		if (done) {
+			break;
+		}
+
+		task_t task;
+		if (thread_pool_find_task(pool, worker, &task)) {
+			thread_pool_run_task(worker, &task);
+			continue;
+		}
+
+		/* nothing left to help with, wait for the stragglers */
+		pthread_mutex_lock(&group->lock);
+		while (group->pending > 0) {
+			pthread_cond_wait(&group->done, &group->lock);
+		}
+		pthread_mutex_unlock(&group->lock);
+		break;
+	}
+}
+
+/**
+ * Initializes a new task_group_t
+ */
+static void task_group_init(task_group_t* group)
+{
+	group->pending = 0;
+	pthread_mutex_init(&group->lock, NULL);
+	pthread_cond_init(&group->done, NULL);
+}
+
+/**
+ * Properly frees a task_group_t
+ */
+static void task_group_free(task_group_t* group)
+{
+	pthread_mutex_destroy(&group->lock);
+	pthread_cond_destroy(&group->done);
+}
+
+object_proto_t thread_pool_proto = {
+	.init = (object_init_t)thread_pool_init,
+	.free = (object_free_t)thread_pool_free
+};
+
+object_proto_t task_group_proto = {
+	.init = (object_init_t)task_group_init,
+	.free = (object_free_t)task_group_free
+};